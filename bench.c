@@ -0,0 +1,1727 @@
+#ifdef JSON_BENCH
+#include <assert.h>
+#include <ctype.h>
+#include "lazy.h"
+#include <malloc.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "file.h"
+#include "json.h"
+#include "number.h"
+#include "path.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scan.h"
+#include "tape.h"
+#include "util.h"
+
+#define BENCH_REPEATS 10
+
+static const char* level_names[SCAN_LEVEL_COUNT] = { "scalar", "sse2", "avx2" };
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* array of count strings of length bytes each, base64-like with a stack-trace style escape every escape_every bytes */
+static char* bench_long_strings(int count, int length, int escape_every)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char* raw = malloc((size_t)count * (length + 4) + 3);
+	assert(raw);
+	char* curr = raw;
+	*curr++ = '[';
+	srand(1);
+	for (int i = 0; i < count; i++)
+	{
+		*curr++ = '"';
+		for (int j = 0; j < length; j++)
+		{
+			if (escape_every > 0 && j % escape_every == escape_every - 1 && j + 1 < length)
+			{
+				*curr++ = '\\';
+				*curr++ = 'n';
+				j++;
+				continue;
+			}
+			*curr++ = alphabet[rand() % 64];
+		}
+		*curr++ = '"';
+		*curr++ = i + 1 < count ? ',' : ']';
+	}
+	*curr = '\0';
+	return raw;
+}
+
+static void bench_scan_string(void)
+{
+	char* raw = bench_long_strings(16 * 1024, 4096, 0);
+	size_t size = strlen(raw);
+	char* stack_traces = bench_long_strings(16 * 1024, 4096, 120);
+	size_t stack_traces_size = strlen(stack_traces);
+
+	for (scan_level_t level = SCAN_SCALAR; level <= scan_supported(); level++)
+	{
+		scan_select(level);
+
+		double start = bench_now();
+		size_t scanned = 0;
+		for (int i = 0; i < BENCH_REPEATS; i++)
+		{
+			for (const char* curr = raw + 2; *curr; curr = scan_string(curr + 1) + 2)
+			{
+				scanned++;
+			}
+		}
+		double kernel = bench_now() - start;
+
+		start = bench_now();
+		for (int i = 0; i < BENCH_REPEATS; i++)
+		{
+			json_state_t doc = json_parse(raw, JSON_DEFAULT_SETTINGS);
+			assert(doc.error == JSON_ERROR_NONE);
+			json_destroy_state(&doc);
+		}
+		double parse = bench_now() - start;
+
+		start = bench_now();
+		for (int i = 0; i < BENCH_REPEATS; i++)
+		{
+			json_state_t doc = json_parse(stack_traces, JSON_DEFAULT_SETTINGS);
+			assert(doc.error == JSON_ERROR_NONE);
+			json_destroy_state(&doc);
+		}
+		double parse_escaped = bench_now() - start;
+
+		printf("scan_string %-6s: kernel %6.2f GB/s, json_parse %6.2f GB/s, json_parse w/ escapes %6.2f GB/s (%zu strings)\n",
+			level_names[level],
+			size * BENCH_REPEATS / kernel * 1e-9,
+			size * BENCH_REPEATS / parse * 1e-9,
+			stack_traces_size * BENCH_REPEATS / parse_escaped * 1e-9,
+			scanned / BENCH_REPEATS);
+	}
+	scan_select(SCAN_LEVEL_COUNT);
+
+	free(raw);
+	free(stack_traces);
+}
+
+/* array of count small records, indented like a pretty printer's output when pretty is set */
+static char* bench_records(int count, bool pretty)
+{
+	char* raw = malloc((size_t)count * 256 + 3);
+	assert(raw);
+	char* curr = raw;
+	*curr++ = '[';
+	for (int i = 0; i < count; i++)
+	{
+		curr += sprintf(curr, pretty
+			? "\n    {\n        \"id\": %d,\n        \"name\": \"record %d\",\n        \"active\": %s,\n        \"tags\": [\n            \"a\",\n            \"b\"\n        ]\n    }%s"
+			: "{\"id\":%d,\"name\":\"record %d\",\"active\":%s,\"tags\":[\"a\",\"b\"]}%s",
+			i, i, i % 2 ? "true" : "false", i + 1 < count ? "," : "");
+	}
+	*curr++ = ']';
+	*curr = '\0';
+	return raw;
+}
+
+static double bench_parse(json_state_t (*parse)(const char*, json_settings_t), const char* raw, json_settings_t settings)
+{
+	double start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		json_state_t doc = parse(raw, settings);
+		assert(doc.error == JSON_ERROR_NONE);
+		json_destroy_state(&doc);
+	}
+	return strlen(raw) * BENCH_REPEATS / (bench_now() - start) * 1e-9;
+}
+
+static void bench_parse_indexed(void)
+{
+	const char* names[] = { "records", "pretty records", "long strings" };
+	char* docs[] = { bench_records(200000, false), bench_records(200000, true), bench_long_strings(4096, 4096, 0) };
+	json_settings_t settings = JSON_DEFAULT_SETTINGS | JSON_USE_ARENA; /* keep allocation out of the comparison as much as possible */
+	for (int i = 0; i < sizeof docs / sizeof * docs; i++)
+	{
+		double bytewise = bench_parse(json_parse, docs[i], settings),
+			indexed = bench_parse(json_parse_indexed, docs[i], settings);
+
+		scan_structural_state_t state = { 0 };
+		size_t length = strlen(docs[i]);
+		uint32_t* positions = malloc(SCAN_POSITIONS_SIZE(length) * sizeof * positions);
+		assert(positions);
+		double start = bench_now();
+		for (int j = 0; j < BENCH_REPEATS; j++)
+		{
+			state = (scan_structural_state_t){ 0 };
+			scan_structurals(&state, docs[i], length, positions);
+		}
+		double stage1 = length * BENCH_REPEATS / (bench_now() - start) * 1e-9;
+		free(positions);
+
+		printf("%-15s: json_parse %5.2f GB/s, json_parse_indexed %5.2f GB/s, stage 1 alone %5.2f GB/s\n", names[i], bytewise, indexed, stage1);
+		free(docs[i]);
+	}
+}
+
+static bool bench_count_handler(void* user, json_event_t event, value_t val)
+{
+	(*(size_t*)user)++;
+	return true;
+}
+
+static void bench_events(void)
+{
+	char* raw = bench_records(200000, false);
+	size_t length = strlen(raw), events = 0;
+	double tree = bench_parse(json_parse, raw, JSON_DEFAULT_SETTINGS);
+
+	double start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		json_state_t doc = json_parse_events(raw, JSON_DEFAULT_SETTINGS, bench_count_handler, &events);
+		assert(doc.error == JSON_ERROR_NONE);
+	}
+	double stream = length * BENCH_REPEATS / (bench_now() - start) * 1e-9;
+
+	printf("records: json_parse %5.2f GB/s, json_parse_events %5.2f GB/s (%zu events)\n", tree, stream, events / BENCH_REPEATS);
+	free(raw);
+}
+
+static size_t bench_tree_walk(value_t val);
+
+static void bench_tree_walk_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	*(size_t*)user += bench_tree_walk(val);
+}
+
+/* visits every value of the tree, returning how many */
+static size_t bench_tree_walk(value_t val)
+{
+	size_t count = 1;
+	if (val.type == TYPE_ARRAY)
+	{
+		for (int i = 0; i < array_count(val.data.array); i++)
+		{
+			count += bench_tree_walk(array_get(val.data.array, i));
+		}
+	}
+	else if (val.type == TYPE_OBJECT)
+	{
+		hashmap_iterate(val.data.object, &count, bench_tree_walk_iterator);
+	}
+	return count;
+}
+
+/* visits every value of the tape, returning how many */
+static size_t bench_tape_walk(const tape_t* tape, size_t index)
+{
+	size_t count = 1;
+	value_type_t type = tape_type(tape, index);
+	for (size_t child = tape_child(tape, index); child != TAPE_NONE; child = tape_next(tape, child))
+	{
+		if (type == TYPE_OBJECT)
+		{
+			child = tape_next(tape, child); /* the key */
+		}
+		count += bench_tape_walk(tape, child);
+	}
+	return count;
+}
+
+static void bench_tape(void)
+{
+	char* raw = bench_records(200000, false);
+	size_t length = strlen(raw), visited = 0;
+	json_state_t doc = json_parse(raw, JSON_DEFAULT_SETTINGS);
+	tape_t tape = tape_parse(raw, JSON_DEFAULT_SETTINGS);
+	assert(doc.error == JSON_ERROR_NONE && tape.error == JSON_ERROR_NONE);
+
+	double start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		tape_t repeat = tape_parse(raw, JSON_DEFAULT_SETTINGS);
+		tape_destroy(&repeat);
+	}
+	double parse = length * BENCH_REPEATS / (bench_now() - start) * 1e-9;
+
+	start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		visited += bench_tree_walk(doc.head);
+	}
+	double tree = (bench_now() - start) / visited * 1e9;
+	visited = 0;
+	start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		visited += bench_tape_walk(&tape, TAPE_ROOT);
+	}
+	double flat = (bench_now() - start) / visited * 1e9;
+
+	printf("records: json_parse %5.2f GB/s, tape_parse %5.2f GB/s, walking tree %.2f ns/value, tape %.2f ns/value, tape is %.1f MB\n",
+		bench_parse(json_parse, raw, JSON_DEFAULT_SETTINGS), parse, tree, flat, (tape.count * sizeof * tape.words + tape.strings_size) * 1e-6);
+	json_destroy_state(&doc);
+	tape_destroy(&tape);
+	free(raw);
+}
+
+/* the fprintf based writer json.c had before json_writer_t, kept to compare against */
+static int bench_legacy_indent = 0;
+#define BENCH_LEGACY_PRINT(frmt, ...) fprintf(out, "\n%*s" frmt, bench_legacy_indent * 4, "", __VA_ARGS__)
+static void bench_legacy_write(FILE* out, value_t val);
+
+struct bench_legacy_print_state
+{
+	FILE* out;
+	int printed_count;
+};
+
+static void bench_legacy_member(hashmap_t map, void* user, const char* key, value_t val)
+{
+	struct bench_legacy_print_state* state = user;
+	FILE* out = state->out;
+	BENCH_LEGACY_PRINT("\"%s\" : ", key);
+	bench_legacy_write(out, val);
+	state->printed_count++;
+	if (state->printed_count < hashmap_count(map))
+	{
+		fprintf(out, ",");
+	}
+}
+
+static void bench_legacy_escaped(FILE* out, char ch)
+{
+	switch (ch)
+	{
+	case '\b': fprintf(out, "\\b"); break;
+	case '\f': fprintf(out, "\\f"); break;
+	case '\n': fprintf(out, "\\n"); break;
+	case '\r': fprintf(out, "\\r"); break;
+	case '\t': fprintf(out, "\\t"); break;
+	default:
+		if (isprint(ch))
+		{
+			fputc(ch, out);
+		}
+		else
+		{
+			fprintf(out, "\\X%02hhX", ch);
+		}
+	}
+}
+
+static void bench_legacy_write(FILE* out, value_t val)
+{
+	switch (val.type)
+	{
+	case TYPE_ARRAY:
+		fprintf(out, "[");
+		bench_legacy_indent++;
+		for (int i = 0; i < array_count(val.data.array); i++)
+		{
+			BENCH_LEGACY_PRINT("%s", "");
+			bench_legacy_write(out, array_get(val.data.array, i));
+			if (i + 1 < array_count(val.data.array))
+			{
+				fprintf(out, ",");
+			}
+		}
+		bench_legacy_indent--;
+		if (array_count(val.data.array) > 0)
+		{
+			BENCH_LEGACY_PRINT("%s", "");
+		}
+		fprintf(out, "]");
+		break;
+	case TYPE_OBJECT:
+	{
+		fprintf(out, "{");
+		bench_legacy_indent++;
+		struct bench_legacy_print_state state = { .out = out };
+		hashmap_iterate(val.data.object, &state, bench_legacy_member);
+		bench_legacy_indent--;
+		BENCH_LEGACY_PRINT("%s}", "");
+		break;
+	}
+	case TYPE_STRING:
+		fprintf(out, "\"");
+		for (char* curr = val.data.string; *curr; curr++)
+		{
+			bench_legacy_escaped(out, *curr);
+		}
+		fprintf(out, "\"");
+		break;
+	case TYPE_NUMBER:
+		fprintf(out, "%f", val.data.number);
+		break;
+	case TYPE_BOOLEAN:
+		fprintf(out, "%s", val.data.boolean ? "true" : "false");
+		break;
+	default:
+		fprintf(out, "null");
+		break;
+	}
+}
+#undef BENCH_LEGACY_PRINT
+
+/* the same trees through the legacy writer, json_write_value and a compact json_writer_t, all to a temporary file */
+static void bench_writer(void)
+{
+	const char* names[] = { "records", "long strings" };
+	char* docs[] = { bench_records(200000, false), bench_long_strings(4096, 4096, 64) };
+	FILE* out = tmpfile();
+	assert(out);
+	for (int i = 0; i < sizeof docs / sizeof * docs; i++)
+	{
+		json_state_t doc = json_parse(docs[i], JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE);
+		double results[3];
+		for (int mode = 0; mode < 3; mode++)
+		{
+			rewind(out);
+			double start = bench_now();
+			if (mode == 0)
+			{
+				bench_legacy_write(out, doc.head);
+			}
+			else
+			{
+				json_writer_t writer = json_writer_create(out, mode == 2 ? JSON_WRITER_COMPACT : 4);
+				assert(writer && json_writer_value(writer, doc.head));
+				json_writer_destroy(writer);
+			}
+			fflush(out);
+			results[mode] = (bench_now() - start) * 1e3;
+		}
+		printf("%-12s: legacy writer %6.1f ms, json_write_value %6.1f ms, compact json_writer_t %6.1f ms for %.1f MB of source\n",
+			names[i], results[0], results[1], results[2], strlen(docs[i]) * 1e-6);
+		json_destroy_state(&doc);
+		free(docs[i]);
+	}
+	fclose(out);
+}
+
+/* records parsed into an arena with and without interning: throughput and heap in use while the document is alive */
+static void bench_intern(void)
+{
+	char* raw = bench_records(200000, false);
+	json_settings_t modes[] = { JSON_USE_ARENA, JSON_USE_ARENA | JSON_INTERN_KEYS, JSON_USE_ARENA | JSON_INTERN_KEYS | JSON_INTERN_STRINGS };
+	const char* names[] = { "arena", "interned keys", "interned keys and strings" };
+	for (int i = 0; i < sizeof modes / sizeof * modes; i++)
+	{
+		struct mallinfo2 before = mallinfo2();
+		json_state_t doc = json_parse(raw, JSON_DEFAULT_SETTINGS | modes[i]);
+		struct mallinfo2 after = mallinfo2();
+		size_t used = after.uordblks + after.hblkhd - before.uordblks - before.hblkhd; /* arena blocks are usually mapped */
+		json_destroy_state(&doc);
+		printf("records, %-26s: json_parse %5.2f GB/s, %6.1f MB\n", names[i], bench_parse(json_parse, raw, JSON_DEFAULT_SETTINGS | modes[i]), used * 1e-6);
+	}
+	free(raw);
+}
+
+static void bench_parse_n(void)
+{
+	const char* names[] = { "records", "pretty records", "long strings" };
+	char* docs[] = { bench_records(200000, false), bench_records(200000, true), bench_long_strings(4096, 4096, 8) };
+	json_settings_t settings = JSON_DEFAULT_SETTINGS | JSON_USE_ARENA;
+	for (int i = 0; i < sizeof docs / sizeof * docs; i++)
+	{
+		double terminated = bench_parse(json_parse, docs[i], settings);
+		size_t length = strlen(docs[i]);
+		double start = bench_now();
+		for (int j = 0; j < BENCH_REPEATS; j++)
+		{
+			json_state_t doc = json_parse_n(docs[i], length, settings);
+			assert(doc.error == JSON_ERROR_NONE);
+			json_destroy_state(&doc);
+		}
+		double bounded = length * BENCH_REPEATS / (bench_now() - start) * 1e-9;
+		printf("%-15s: json_parse %5.2f GB/s, json_parse_n %5.2f GB/s\n", names[i], terminated, bounded);
+		free(docs[i]);
+	}
+}
+
+static bool bench_line_handler(void* user, size_t line, json_state_t doc)
+{
+	assert(doc.error == JSON_ERROR_NONE);
+	json_destroy_state(&doc);
+	(*(size_t*)user)++;
+	return true;
+}
+
+/* newline delimited records on 1, 2, 4... threads up to the core count */
+static void bench_lines(void)
+{
+	const int count = 500000;
+	char* raw = malloc((size_t)count * 128);
+	assert(raw);
+	char* curr = raw;
+	for (int i = 0; i < count; i++)
+	{
+		curr += sprintf(curr, "{\"ts\": %d, \"level\": \"info\", \"msg\": \"request %d served\", \"ms\": %d.%d}\n", 1700000000 + i, i, i % 97, i % 10);
+	}
+	size_t length = (size_t)(curr - raw);
+
+	json_settings_t settings = JSON_DEFAULT_SETTINGS | JSON_USE_ARENA;
+	for (int threads = 1; threads <= pool_cores(); threads *= 2)
+	{
+		size_t lines = 0;
+		double start = bench_now();
+		assert(json_parse_lines(raw, length, settings, threads, bench_line_handler, &lines) && lines == (size_t)count);
+		printf("json_parse_lines: %2d threads %5.2f GB/s\n", threads, length / (bench_now() - start) * 1e-9);
+	}
+	free(raw);
+}
+
+/* one field read out of a document a few megabytes long, at its start, middle and end: built tree against lazy walk */
+static void bench_lazy(void)
+{
+	char* records = bench_records(30000, false);
+	size_t size = strlen(records) + 128;
+	char* raw = malloc(size);
+	assert(raw);
+	snprintf(raw, size, "{\"meta\": {\"id\": 7}, \"items\": %s, \"status\": \"ok\"}", records);
+	free(records);
+	size_t length = strlen(raw);
+
+	const char* names[] = { "meta.id", "items[15000].id", "status" };
+	double tree[3] = { 0 }, lazy_seconds[3] = { 0 };
+	for (int field = 0; field < 3; field++)
+	{
+		double start = bench_now();
+		for (int i = 0; i < BENCH_REPEATS; i++)
+		{
+			json_state_t doc = json_parse_n(raw, length, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA);
+			hashmap_t root = doc.head.data.object;
+			value_t val = field == 0 ? hashmap_get(hashmap_get(root, "meta").data.object, "id")
+				: field == 1 ? hashmap_get(array_get(hashmap_get(root, "items").data.array, 15000).data.object, "id")
+				: hashmap_get(root, "status");
+			assert(doc.error == JSON_ERROR_NONE && val.type != TYPE_NULL);
+			json_destroy_state(&doc);
+		}
+		tree[field] = (bench_now() - start) / BENCH_REPEATS;
+
+		start = bench_now();
+		for (int i = 0; i < BENCH_REPEATS; i++)
+		{
+			lazy_t lazy = lazy_open(raw, length, JSON_DEFAULT_SETTINGS);
+			size_t index = field == 0 ? lazy_find(&lazy, lazy_find(&lazy, lazy.root, "meta"), "id")
+				: field == 1 ? lazy_find(&lazy, lazy_at(&lazy, lazy_find(&lazy, lazy.root, "items"), 15000), "id")
+				: lazy_find(&lazy, lazy.root, "status");
+			json_state_t val = lazy_get(&lazy, index);
+			assert(val.error == JSON_ERROR_NONE && val.head.type != TYPE_NULL);
+			json_destroy_state(&val);
+			lazy_close(&lazy);
+		}
+		lazy_seconds[field] = (bench_now() - start) / BENCH_REPEATS;
+	}
+	printf("%.1f MB document:", length * 1e-6);
+	for (int field = 0; field < 3; field++)
+	{
+		printf(" %s json_parse %.1f us, lazy %.1f us;", names[field], tree[field] * 1e6, lazy_seconds[field] * 1e6);
+	}
+	printf("\n");
+	free(raw);
+}
+
+static char* bench_copy_string(const char* str)
+{
+	size_t size = strlen(str) + 1;
+	char* copy = malloc(size);
+	assert(copy);
+	return memcpy(copy, str, size);
+}
+
+static bool bench_path_count(void* user, value_t val)
+{
+	(*(size_t*)user)++;
+	return true;
+}
+
+/*	routing on long keys of a wide object: chained lookups hashing each key every time against compiled paths,
+	then every record's name out of a document through a wildcard, on the tree and on events */
+static void bench_path(void)
+{
+	const int count = 200000, lookups = 2000000;
+	hashmap_t headers = hashmap_create();
+	char key[64];
+	for (int i = 0; i < 32; i++)
+	{
+		snprintf(key, sizeof key, "x-request-header-number-%d", i);
+		hashmap_set(headers, bench_copy_string(key), (value_t){ .type = TYPE_OBJECT, .data.object = hashmap_create() });
+	}
+	hashmap_set(hashmap_get(headers, "x-request-header-number-7").data.object, bench_copy_string("x-forwarded-for-address"), (value_t){ .type = TYPE_INTEGER, .data.integer = 7 });
+	value_t root = { .type = TYPE_OBJECT, .data.object = headers };
+
+	size_t found = 0;
+	double start = bench_now();
+	for (int i = 0; i < lookups; i++)
+	{
+		hashmap_t header = hashmap_get(headers, "x-request-header-number-7").data.object;
+		found += hashmap_exists(header, "x-forwarded-for-address") && hashmap_get(header, "x-forwarded-for-address").data.integer == 7;
+	}
+	double chained = (bench_now() - start) / lookups * 1e9;
+
+	path_t route = path_compile("/x-request-header-number-7/x-forwarded-for-address");
+	assert(route);
+	start = bench_now();
+	for (int i = 0; i < lookups; i++)
+	{
+		value_t val;
+		found += path_get(route, root, &val) && val.data.integer == 7;
+	}
+	double compiled = (bench_now() - start) / lookups * 1e9;
+	assert(found == (size_t)lookups * 2);
+	path_destroy(route);
+
+	char* raw = bench_records(count, false);
+	path_t names = path_compile("/*/name");
+	assert(names);
+	found = 0;
+	start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		json_state_t tree = json_parse(raw, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA);
+		path_select(names, tree.head, bench_path_count, &found);
+		json_destroy_state(&tree);
+	}
+	double selected = (bench_now() - start) / BENCH_REPEATS * 1e3;
+	start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		json_state_t filtered = path_parse_events(names, raw, JSON_DEFAULT_SETTINGS, bench_count_handler, &found);
+		assert(filtered.error == JSON_ERROR_NONE);
+	}
+	double streamed = (bench_now() - start) / BENCH_REPEATS * 1e3;
+	assert(found == (size_t)count * BENCH_REPEATS * 2);
+	path_destroy(names);
+
+	printf("two level route: hashmap_get chain %.1f ns, path_get %.1f ns; records /*/name: json_parse + path_select %.1f ms, path_parse_events %.1f ms\n",
+		chained, compiled, selected, streamed);
+	json_destroy((value_t){ .type = TYPE_OBJECT, .data.object = headers });
+	free(raw);
+}
+
+struct bench_concurrent
+{
+	const char* raw;
+	int rounds;
+};
+
+/* parses and writes back the same document over and over with nothing shared between threads but the source */
+static int bench_concurrent_work(void* user)
+{
+	const struct bench_concurrent* concurrent = user;
+	for (int i = 0; i < concurrent->rounds; i++)
+	{
+		json_state_t doc = json_parse(concurrent->raw, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_INTERN_KEYS);
+		json_writer_t writer = json_writer_create(NULL, i % 2 ? JSON_WRITER_COMPACT : 2);
+		assert(doc.error == JSON_ERROR_NONE && writer && json_writer_value(writer, doc.head));
+		json_writer_destroy(writer);
+		json_destroy_state(&doc);
+	}
+	return 0;
+}
+
+/* documents parsed and serialized per second on 1, 2, 4... threads up to the core count, each thread doing the same work */
+static void bench_concurrent(void)
+{
+	char* raw = bench_records(2000, false);
+	struct bench_concurrent concurrent = { .raw = raw, .rounds = 200 };
+	double single = 0.0;
+	for (int threads = 1; threads <= pool_cores(); threads *= 2)
+	{
+		double start = bench_now();
+		pool_t pool = pool_start(threads, bench_concurrent_work, &concurrent);
+		assert(pool);
+		pool_join(pool);
+		double per_second = threads * concurrent.rounds / (bench_now() - start);
+		single = threads == 1 ? per_second : single;
+		printf("parse and write: %2d threads %8.0f docs/s, %5.2fx one thread\n", threads, per_second, per_second / single);
+	}
+	free(raw);
+}
+
+/* json_parse_events against a stream fed the same document in chunks of a few sizes */
+static void bench_stream(void)
+{
+	char* raw = bench_records(200000, false);
+	size_t length = strlen(raw), events = 0;
+
+	double start = bench_now();
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		json_state_t doc = json_parse_events(raw, JSON_DEFAULT_SETTINGS, bench_count_handler, &events);
+		assert(doc.error == JSON_ERROR_NONE);
+	}
+	printf("records: json_parse_events %5.2f GB/s", length * BENCH_REPEATS / (bench_now() - start) * 1e-9);
+
+	size_t chunks[] = { 1 << 6, 1 << 12, 1 << 16 };
+	for (int i = 0; i < sizeof chunks / sizeof * chunks; i++)
+	{
+		start = bench_now();
+		for (int j = 0; j < BENCH_REPEATS; j++)
+		{
+			json_stream_t stream = json_stream_create(JSON_DEFAULT_SETTINGS, bench_count_handler, &events);
+			assert(stream);
+			for (size_t k = 0; k < length; k += chunks[i])
+			{
+				json_stream_feed(stream, raw + k, length - k < chunks[i] ? length - k : chunks[i]);
+			}
+			json_state_t doc = json_stream_finish(stream);
+			assert(doc.error == JSON_ERROR_NONE);
+		}
+		printf(", %zu byte chunks %5.2f GB/s", chunks[i], length * BENCH_REPEATS / (bench_now() - start) * 1e-9);
+	}
+	printf("\n");
+	free(raw);
+}
+
+/* the number parser json.c shipped with before number.c, kept to compare against */
+static double bench_legacy_digits(const char** praw)
+{
+	double sign = 1.0, res = 0.0;
+	const char* raw = *praw;
+	if (*raw == '-')
+	{
+		sign = -1.0;
+		raw++;
+	}
+	for (; *raw >= '0' && *raw <= '9'; raw++)
+	{
+		res = res * 10 + *raw - '0';
+	}
+	*praw = raw;
+	return res * sign;
+}
+
+static double bench_legacy_number(const char** praw)
+{
+	const char* raw = *praw;
+	double out = bench_legacy_digits(&raw);
+	if (*raw == '.')
+	{
+		raw++;
+		const char* start = raw;
+		out += bench_legacy_digits(&raw) / pow(10.0, (double)(raw - start));
+	}
+	if (*raw == 'e' || *raw == 'E')
+	{
+		raw++;
+		if (*raw == '+')
+		{
+			raw++;
+		}
+		out *= pow(10.0, bench_legacy_digits(&raw));
+	}
+	*praw = raw;
+	return out;
+}
+
+static double bench_new_number(const char** praw)
+{
+	number_decimal_t decimal;
+	const char* end;
+	number_status_t status = number_scan(*praw, &decimal, &end);
+	assert(status == NUMBER_OK);
+	double res = number_to_double(decimal, *praw, (size_t)(end - *praw));
+	*praw = end;
+	return res;
+}
+
+static double bench_strtod_number(const char** praw)
+{
+	char* end;
+	double res = strtod(*praw, &end);
+	*praw = end;
+	return res;
+}
+
+/* count space separated coordinates shaped like geojson's, longitude and latitude with up to 15 decimals */
+static char* bench_coordinates(int count)
+{
+	char* raw = malloc((size_t)count * 32 + 1);
+	assert(raw);
+	char* curr = raw;
+	srand(7);
+	for (int i = 0; i < count; i++)
+	{
+		double value = (rand() / (double)RAND_MAX - 0.5) * (i % 2 ? 180.0 : 360.0);
+		curr += sprintf(curr, "%.*f ", 6 + rand() % 10, value);
+	}
+	*curr = '\0';
+	return raw;
+}
+
+static void bench_numbers(void)
+{
+	const int count = 1000000;
+	char* raw = bench_coordinates(count);
+	const char* names[] = { "strtod", "legacy", "number.c" }; /* strtod first, the others are checked against it */
+	double (*convert[])(const char**) = { bench_strtod_number, bench_legacy_number, bench_new_number };
+	double* results[3];
+	for (int i = 0; i < 3; i++)
+	{
+		results[i] = malloc(count * sizeof * results[i]);
+		assert(results[i]);
+		double start = bench_now();
+		for (int j = 0; j < BENCH_REPEATS; j++)
+		{
+			const char* curr = raw;
+			for (int k = 0; k < count; k++, curr++)
+			{
+				results[i][k] = convert[i](&curr);
+			}
+		}
+		double ns = (bench_now() - start) * 1e9 / ((double)count * BENCH_REPEATS);
+		printf("%-8s: %6.1f ns/number", names[i], ns);
+		if (i > 0)
+		{
+			int wrong = 0;
+			for (int k = 0; k < count; k++)
+			{
+				wrong += memcmp(&results[i][k], &results[0][k], sizeof(double)) != 0;
+			}
+			printf(", %d of %d differ from strtod\n", wrong, count);
+		}
+		else
+		{
+			printf("\n");
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		free(results[i]);
+	}
+	free(raw);
+}
+
+/*	formats the coordinates' doubles with the legacy writer's "%f", with the shortest "%.17g" can give (trying fewer
+	digits first, as printf has no shortest mode) and with number_write_double, then checks which read back exactly */
+static void bench_write_numbers(void)
+{
+	const int count = 200000;
+	char* raw = bench_coordinates(count);
+	double* values = malloc(count * sizeof * values);
+	char* out = malloc((size_t)count * NUMBER_DOUBLE_SIZE * 2);
+	assert(values && out);
+	const char* curr = raw;
+	for (int i = 0; i < count; i++, curr++)
+	{
+		values[i] = bench_strtod_number(&curr);
+	}
+
+	const char* names[] = { "%f", "shortest %g", "number.c" };
+	for (int mode = 0; mode < 3; mode++)
+	{
+		char* end = out;
+		double start = bench_now();
+		for (int i = 0; i < count; i++)
+		{
+			if (mode == 0)
+			{
+				end += sprintf(end, "%f", values[i]);
+			}
+			else if (mode == 1)
+			{
+				for (int precision = 1; precision <= 17; precision++)
+				{
+					int length = sprintf(end, "%.*g", precision, values[i]);
+					if (strtod(end, NULL) == values[i] || precision == 17)
+					{
+						end += length;
+						break;
+					}
+				}
+			}
+			else
+			{
+				end += number_write_double(values[i], end);
+			}
+			*end++ = ' ';
+		}
+		double ns = (bench_now() - start) * 1e9 / count;
+
+		int wrong = 0;
+		curr = out;
+		for (int i = 0; i < count; i++, curr++)
+		{
+			wrong += bench_strtod_number(&curr) != values[i];
+		}
+		printf("%-12s: %6.1f ns/number, %4.1f bytes/number, %d of %d don't read back\n", names[mode], ns, (double)(end - out) / count - 1, wrong, count);
+	}
+	free(out);
+	free(values);
+	free(raw);
+}
+
+/* the hashmap util.c had before open addressing, kept to compare against: djb hashes only, probing stops at the end */
+struct bench_legacy_pair
+{
+	const char* key;
+	uintmax_t key_hash;
+	value_t value;
+};
+
+struct bench_legacy_map
+{
+	int count,
+		reserved;
+	struct bench_legacy_pair* data;
+};
+
+static uintmax_t bench_legacy_djb3(const char* key)
+{
+	uintmax_t hash = 5381;
+	do
+	{
+		hash = ((hash << 5) + hash) ^ *key;
+	} while (*key++);
+	return hash;
+}
+
+static int bench_legacy_find(struct bench_legacy_map* map, uintmax_t hash)
+{
+	int i;
+	for (i = hash % map->reserved; i < map->reserved && map->data[i].key_hash != hash; i++);
+	return i;
+}
+
+static void bench_legacy_set(struct bench_legacy_map* map, const char* key, value_t val)
+{
+	uintmax_t hash = bench_legacy_djb3(key);
+	int i = bench_legacy_find(map, hash);
+	if (i < map->reserved)
+	{
+		map->data[i].value = val;
+		return;
+	}
+
+	for (i = hash % map->reserved; i < map->reserved && map->data[i].key_hash != 0; i++);
+	if (i >= map->reserved)
+	{
+		struct bench_legacy_map prev = *map;
+		*map = (struct bench_legacy_map){ .reserved = prev.reserved * 2, .data = calloc(prev.reserved * 2, sizeof * map->data) };
+		for (int j = 0; j < prev.reserved; j++)
+		{
+			if (prev.data[j].key_hash != 0)
+			{
+				bench_legacy_set(map, prev.data[j].key, prev.data[j].value);
+			}
+		}
+		free(prev.data);
+		bench_legacy_set(map, key, val);
+		return;
+	}
+	map->count++;
+	map->data[i] = (struct bench_legacy_pair){ key, hash, val };
+}
+
+static void bench_map_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	*(double*)user += val.data.number;
+}
+
+/* insert, lookup and iterate for the current hashmap and the legacy one. "wrong" counts lookups that found another key's value */
+static void bench_hashmap(void)
+{
+	printf("hashmap: count, map, insert ns/key, lookup ns/key, iterate ns/key, wrong lookups\n");
+	int sizes[] = { 8, 64, 1000, 100000 };
+	for (int s = 0; s < sizeof sizes / sizeof * sizes; s++)
+	{
+		int count = sizes[s], rounds = 400000 / count;
+		char* keys = malloc((size_t)count * 16);
+		for (int i = 0; i < count; i++)
+		{
+			snprintf(&keys[i * 16], 16, "field_%d", i);
+		}
+
+		double start = bench_now(), sum = 0;
+		int wrong = 0;
+		for (int r = 0; r < rounds; r++)
+		{
+			hashmap_t map = hashmap_create();
+			for (int i = 0; i < count; i++)
+			{
+				hashmap_set(map, &keys[i * 16], (value_t) { .type = TYPE_NUMBER, .data.number = i });
+			}
+			hashmap_destroy(map);
+		}
+		double insert = bench_now() - start;
+
+		hashmap_t map = hashmap_create();
+		for (int i = 0; i < count; i++)
+		{
+			hashmap_set(map, &keys[i * 16], (value_t) { .type = TYPE_NUMBER, .data.number = i });
+		}
+		start = bench_now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				int j = (int)((i * 40503ll) % count); /* scattered, sequential keys would favour djb's clustered hashes */
+				wrong += hashmap_get(map, &keys[j * 16]).data.number != j;
+			}
+		}
+		double lookup = bench_now() - start;
+		start = bench_now();
+		for (int r = 0; r < rounds; r++)
+		{
+			hashmap_iterate(map, &sum, bench_map_iterator);
+		}
+		double iterate = bench_now() - start, keys_done = (double)rounds * count * 1e-9;
+		hashmap_destroy(map);
+		printf("%d, util.c, %.1f, %.1f, %.1f, %d\n", count, insert / keys_done, lookup / keys_done, iterate / keys_done, wrong / rounds);
+
+		start = bench_now();
+		for (int r = 0; r < rounds; r++)
+		{
+			struct bench_legacy_map legacy = { .reserved = 64, .data = calloc(64, sizeof * legacy.data) };
+			for (int i = 0; i < count; i++)
+			{
+				bench_legacy_set(&legacy, &keys[i * 16], (value_t) { .type = TYPE_NUMBER, .data.number = i });
+			}
+			free(legacy.data);
+		}
+		insert = bench_now() - start;
+
+		struct bench_legacy_map legacy = { .reserved = 64, .data = calloc(64, sizeof * legacy.data) };
+		for (int i = 0; i < count; i++)
+		{
+			bench_legacy_set(&legacy, &keys[i * 16], (value_t) { .type = TYPE_NUMBER, .data.number = i });
+		}
+		wrong = 0;
+		start = bench_now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				int j = (int)((i * 40503ll) % count),
+					found = bench_legacy_find(&legacy, bench_legacy_djb3(&keys[j * 16]));
+				wrong += found >= legacy.reserved || legacy.data[found].value.data.number != j;
+			}
+		}
+		lookup = bench_now() - start;
+		start = bench_now();
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < legacy.reserved; i++)
+			{
+				if (legacy.data[i].key_hash != 0)
+				{
+					bench_map_iterator(NULL, &sum, legacy.data[i].key, legacy.data[i].value);
+				}
+			}
+		}
+		iterate = bench_now() - start;
+		printf("%d, legacy, %.1f, %.1f, %.1f, %d (%d slots)\n", count, insert / keys_done, lookup / keys_done, iterate / keys_done, wrong / rounds, legacy.reserved);
+		free(legacy.data);
+		free(keys);
+		if (sum == 0.5)
+		{
+			printf("\n");
+		}
+	}
+}
+
+/*	The suite: deterministic corpora shaped like real workloads, each parsed, written and destroyed while timing,
+	counting allocations and watching peak RSS. The comparisons above are for changing one piece of the parser,
+	the suite is for noticing when a commit made the whole of it slower, so it can write its results as JSON
+	lines and compare them against an earlier run's */
+
+#ifdef BENCH_WRAP_ALLOC
+#include <stdatomic.h>
+
+/* the build links the process with --wrap, so every malloc, calloc and realloc of the process goes through these */
+static atomic_size_t bench_allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+	return __real_realloc(ptr, size);
+}
+#endif
+
+/* allocations made by the process so far, or SIZE_MAX where they aren't counted */
+static size_t bench_allocation_count(void)
+{
+#ifdef BENCH_WRAP_ALLOC
+	return atomic_load_explicit(&bench_allocations, memory_order_relaxed);
+#else
+	return SIZE_MAX;
+#endif
+}
+
+/* resets the peak resident set size to what is resident now */
+static void bench_peak_reset(void)
+{
+#ifdef __linux__
+	FILE* clear = fopen("/proc/self/clear_refs", "w");
+	if (clear != NULL)
+	{
+		fputs("5", clear);
+		fclose(clear);
+	}
+#endif
+}
+
+/* peak resident set size since the last bench_peak_reset in KiB, or -1 where it can't be read */
+static long bench_peak_kb(void)
+{
+	long peak = -1;
+#ifdef __linux__
+	FILE* status = fopen("/proc/self/status", "r");
+	if (status != NULL)
+	{
+		char line[256];
+		while (fgets(line, sizeof line, status) != NULL)
+		{
+			if (strncmp(line, "VmHWM:", 6) == 0)
+			{
+				peak = strtol(line + 6, NULL, 10);
+				break;
+			}
+		}
+		fclose(status);
+	}
+#endif
+	return peak;
+}
+
+/* xorshift64, seeded the same every corpus so every run and every machine measures the same bytes */
+static uint64_t bench_random_state;
+
+static uint32_t bench_random(uint32_t below)
+{
+	bench_random_state ^= bench_random_state << 13;
+	bench_random_state ^= bench_random_state >> 7;
+	bench_random_state ^= bench_random_state << 17;
+	return (uint32_t)(bench_random_state >> 32) % below;
+}
+
+struct bench_text
+{
+	char* data;
+	size_t length,
+		reserved;
+};
+
+static void bench_append(struct bench_text* text, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (text->length + (size_t)written + 1 > text->reserved)
+	{
+		text->reserved = (text->length + (size_t)written + 1) * 2;
+		text->data = realloc(text->data, text->reserved);
+		assert(text->data != NULL);
+	}
+	va_start(args, format);
+	vsnprintf(&text->data[text->length], (size_t)written + 1, format, args);
+	va_end(args);
+	text->length += (size_t)written;
+}
+
+/* objects and arrays 64 deep, alternating, each level with a few members before the next */
+static void bench_corpus_deep(struct bench_text* text, size_t size)
+{
+	bench_append(text, "[");
+	for (int chunk = 0; text->length < size; chunk++)
+	{
+		bench_append(text, chunk > 0 ? ",\n" : "\n");
+		for (int level = 0; level < 64; level++)
+		{
+			if (level % 2 == 0)
+			{
+				bench_append(text, "{\"level\": %d, \"name\": \"node%u\", \"child\": ", level, bench_random(100000));
+			}
+			else
+			{
+				bench_append(text, "[%u, true, null, ", bench_random(1000));
+			}
+		}
+		bench_append(text, "\"leaf\"");
+		for (int level = 63; level >= 0; level--)
+		{
+			bench_append(text, level % 2 == 0 ? "}" : "]");
+		}
+	}
+	bench_append(text, "\n]");
+}
+
+/* rows of 16 integers, decimals and exponents, like coordinates and sensor readings */
+static void bench_corpus_numbers(struct bench_text* text, size_t size)
+{
+	bench_append(text, "[");
+	for (int row = 0; text->length < size; row++)
+	{
+		bench_append(text, row > 0 ? ",\n[" : "\n[");
+		for (int i = 0; i < 16; i++)
+		{
+			const char* separator = i > 0 ? ", " : "";
+			switch (i % 4)
+			{
+			case 0:
+				bench_append(text, "%s%u", separator, bench_random(UINT32_MAX));
+				break;
+			case 1:
+				bench_append(text, "%s-%u", separator, bench_random(1000));
+				break;
+			case 2:
+				bench_append(text, "%s%.*f", separator, (int)bench_random(9), bench_random(2000000) / 1000.0 - 1000.0);
+				break;
+			default:
+				bench_append(text, "%s%.6e", separator, (bench_random(2000000) / 1000.0 - 1000.0) * pow(10.0, (int)bench_random(40) - 20));
+				break;
+			}
+		}
+		bench_append(text, "]");
+	}
+	bench_append(text, "\n]");
+}
+
+/* strings of 200 to 2200 bytes: prose-like text with escapes and multi-byte characters sprinkled in */
+static void bench_corpus_strings(struct bench_text* text, size_t size)
+{
+	static const char* pieces[] = { "lorem ", "ipsum ", "dolor ", "sit ", "amet, ", "\\n", "\\\"quoted\\\" ", "\\\\path\\\\ ", "caf\xc3\xa9 ", "\\u00e9t\\u00e9 ", "\xe2\x82\xac ", "\\t" };
+	bench_append(text, "[");
+	for (int string = 0; text->length < size; string++)
+	{
+		bench_append(text, string > 0 ? ",\n\"" : "\n\"");
+		size_t end = text->length + 200 + bench_random(2000);
+		while (text->length < end)
+		{
+			bench_append(text, "%s", pieces[bench_random(sizeof pieces / sizeof * pieces)]);
+		}
+		bench_append(text, "\"");
+	}
+	bench_append(text, "\n]");
+}
+
+/* one small record of a few members, like an API response's items */
+static void bench_small_object(struct bench_text* text)
+{
+	static const char* tags[] = { "red", "green", "blue", "admin", "guest" };
+	bench_append(text, "{\"id\": %u, \"active\": %s, \"score\": %.2f, \"tag\": \"%s\"",
+		bench_random(10000000), bench_random(2) ? "true" : "false", bench_random(100000) / 100.0, tags[bench_random(5)]);
+	if (bench_random(3) == 0)
+	{
+		bench_append(text, ", \"parent\": null");
+	}
+	bench_append(text, "}");
+}
+
+/* an array of many small objects */
+static void bench_corpus_objects(struct bench_text* text, size_t size)
+{
+	bench_append(text, "[");
+	for (int object = 0; text->length < size; object++)
+	{
+		bench_append(text, object > 0 ? ",\n" : "\n");
+		bench_small_object(text);
+	}
+	bench_append(text, "\n]");
+}
+
+/* log records, one document per line */
+static void bench_corpus_ndjson(struct bench_text* text, size_t size)
+{
+	static const char* levels[] = { "debug", "info", "info", "warn", "error" };
+	while (text->length < size)
+	{
+		bench_append(text, "{\"ts\": %u%06u, \"level\": \"%s\", \"msg\": \"request %u served\", \"ms\": %.1f, \"user\": ",
+			1700000000 + bench_random(1000000), bench_random(1000000), levels[bench_random(5)], bench_random(100000), bench_random(50000) / 10.0);
+		bench_small_object(text);
+		bench_append(text, ", \"roles\": [\"read\"%s]}\n", bench_random(4) == 0 ? ", \"write\"" : "");
+	}
+}
+
+struct bench_corpus
+{
+	const char* name;
+	void (*generate)(struct bench_text* text, size_t size);
+	bool lines; /* one document per line instead of one document */
+};
+
+static const struct bench_corpus bench_corpora[] = {
+	{ "deep", bench_corpus_deep },
+	{ "numbers", bench_corpus_numbers },
+	{ "strings", bench_corpus_strings },
+	{ "objects", bench_corpus_objects },
+	{ "ndjson", bench_corpus_ndjson, true },
+};
+
+struct bench_result
+{
+	const char* corpus;
+	const char* op;
+	size_t bytes, /* bytes read or written, 0 when the op isn't about text */
+		values, /* values, or for hashmaps keys, handled by one repeat */
+		docs; /* documents, or for hashmaps maps, handled by one repeat */
+	double seconds; /* best of the repeats */
+	size_t allocations; /* by one repeat, SIZE_MAX if they aren't counted */
+	long peak_kb;
+};
+
+struct bench_options
+{
+	size_t size; /* bytes of each corpus */
+	int repeats;
+	FILE* json; /* where results go as JSON lines, NULL for none */
+	bool table; /* print results as a table on stdout */
+};
+
+static void bench_report(const struct bench_options* options, const struct bench_result* result)
+{
+	double ns_per_value = result->seconds * 1e9 / (double)result->values,
+		mb_per_s = (double)result->bytes / result->seconds / 1e6;
+	char allocations[32] = "null", speed[32] = "null", peak[32] = "null";
+	if (result->allocations != SIZE_MAX)
+	{
+		snprintf(allocations, sizeof allocations, "%.1f", (double)result->allocations / (double)result->docs);
+	}
+	if (result->bytes > 0)
+	{
+		snprintf(speed, sizeof speed, "%.1f", mb_per_s);
+	}
+	if (result->peak_kb >= 0)
+	{
+		snprintf(peak, sizeof peak, "%ld", result->peak_kb);
+	}
+
+	if (options->table)
+	{
+		printf("%-8s %-14s %9s %9.2f %12s %12s\n", result->corpus, result->op, result->bytes > 0 ? speed : "-", ns_per_value,
+			result->allocations != SIZE_MAX ? allocations : "-", result->peak_kb >= 0 ? peak : "-");
+	}
+	if (options->json != NULL)
+	{
+		fprintf(options->json, "{\"corpus\": \"%s\", \"op\": \"%s\", \"bytes\": %zu, \"values\": %zu, \"docs\": %zu, \"seconds\": %.9f, "
+			"\"mb_per_s\": %s, \"ns_per_value\": %.3f, \"allocs_per_doc\": %s, \"peak_rss_kb\": %s}\n",
+			result->corpus, result->op, result->bytes, result->values, result->docs, result->seconds, speed, ns_per_value, allocations, peak);
+	}
+}
+
+/* what one repeat of an op measured */
+struct bench_sample
+{
+	double seconds;
+	size_t allocations;
+	long peak_kb;
+};
+
+static void bench_sample_start(struct bench_sample* sample)
+{
+	bench_peak_reset();
+	sample->allocations = bench_allocation_count();
+	sample->seconds = bench_now();
+}
+
+static void bench_sample_stop(struct bench_sample* sample)
+{
+	sample->seconds = bench_now() - sample->seconds;
+	size_t allocations = bench_allocation_count();
+	sample->allocations = allocations == SIZE_MAX ? SIZE_MAX : allocations - sample->allocations;
+	sample->peak_kb = bench_peak_kb();
+}
+
+/* folds a repeat into result: the best time, the last allocation count and the highest peak */
+static void bench_sample_keep(struct bench_result* result, const struct bench_sample* sample)
+{
+	if (result->seconds == 0 || sample->seconds < result->seconds)
+	{
+		result->seconds = sample->seconds;
+	}
+	result->allocations = sample->allocations;
+	result->peak_kb = sample->peak_kb > result->peak_kb ? sample->peak_kb : result->peak_kb;
+}
+
+/* parses the corpus into docs, one per line for NDJSON */
+static void bench_suite_parse(const struct bench_text* text, bool lines, json_settings_t settings, json_state_t* docs)
+{
+	if (!lines)
+	{
+		docs[0] = json_parse_n(text->data, text->length, settings);
+		return;
+	}
+	const char* curr = text->data, * end = text->data + text->length;
+	for (size_t doc = 0; curr < end; doc++)
+	{
+		const char* line_end = memchr(curr, '\n', (size_t)(end - curr));
+		line_end = line_end != NULL ? line_end : end;
+		docs[doc] = json_parse_n(curr, (size_t)(line_end - curr), settings);
+		curr = line_end + 1;
+	}
+}
+
+/* parse, json_write_value and destroy of one corpus, with and without an arena */
+static void bench_suite_corpus(const struct bench_options* options, const struct bench_corpus* corpus)
+{
+	struct bench_text text = { 0 };
+	bench_random_state = 0x9E3779B97F4A7C15ull;
+	corpus->generate(&text, options->size);
+
+	size_t count = 1;
+	if (corpus->lines)
+	{
+		count = 0;
+		for (size_t i = 0; i < text.length; i++)
+		{
+			count += text.data[i] == '\n';
+		}
+	}
+	json_state_t* docs = malloc(sizeof * docs * count);
+	FILE* out = tmpfile();
+	assert(docs != NULL && out != NULL);
+
+	static const struct
+	{
+		const char* name;
+		json_settings_t settings;
+	} modes[] = { { "", JSON_DEFAULT_SETTINGS }, { "_arena", JSON_DEFAULT_SETTINGS | JSON_USE_ARENA } };
+	for (int m = 0; m < sizeof modes / sizeof * modes; m++)
+	{
+		char names[3][32];
+		snprintf(names[0], sizeof names[0], "parse%s", modes[m].name);
+		snprintf(names[1], sizeof names[1], "write%s", modes[m].name);
+		snprintf(names[2], sizeof names[2], "destroy%s", modes[m].name);
+		struct bench_result parse = { corpus->name, names[0], text.length, 0, count, .peak_kb = -1 },
+			write = { corpus->name, names[1], 0, 0, count, .peak_kb = -1 },
+			destroy = { corpus->name, names[2], 0, 0, count, .peak_kb = -1 };
+
+		for (int r = 0; r < options->repeats; r++)
+		{
+			struct bench_sample sample;
+			bench_sample_start(&sample);
+			bench_suite_parse(&text, corpus->lines, modes[m].settings, docs);
+			bench_sample_stop(&sample);
+			bench_sample_keep(&parse, &sample);
+
+			size_t values = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				assert(docs[i].error == JSON_ERROR_NONE);
+				values += bench_tree_walk(docs[i].head);
+			}
+			parse.values = write.values = destroy.values = values;
+
+			rewind(out);
+			bench_sample_start(&sample);
+			for (size_t i = 0; i < count; i++)
+			{
+				assert(json_write_value(out, docs[i].head));
+			}
+			fflush(out);
+			bench_sample_stop(&sample);
+			bench_sample_keep(&write, &sample);
+			write.bytes = (size_t)ftell(out);
+
+			bench_sample_start(&sample);
+			for (size_t i = 0; i < count; i++)
+			{
+				json_destroy_state(&docs[i]);
+			}
+			bench_sample_stop(&sample);
+			bench_sample_keep(&destroy, &sample);
+		}
+		bench_report(options, &parse);
+		bench_report(options, &write);
+		bench_report(options, &destroy);
+	}
+
+	fclose(out);
+	free(docs);
+	free(text.data);
+}
+
+/* room for the longest key bench_suite_hashmap can format */
+#define BENCH_KEY_SIZE sizeof "key_4294967295_-2147483648"
+
+/* hashmap_set, hashmap_get and hashmap_remove over maps of a few sizes, the sizes objects in documents have */
+static void bench_suite_hashmap(const struct bench_options* options)
+{
+	int sizes[] = { 8, 64, 4096 };
+	for (int s = 0; s < sizeof sizes / sizeof * sizes; s++)
+	{
+		int count = sizes[s], maps = (int)(options->size / 16 / (size_t)count) + 1;
+		char* keys = malloc((size_t)count * BENCH_KEY_SIZE);
+		hashmap_t* map = malloc(sizeof * map * (size_t)maps);
+		assert(keys != NULL && map != NULL);
+		bench_random_state = 0x9E3779B97F4A7C15ull;
+		for (int i = 0; i < count; i++)
+		{
+			snprintf(&keys[i * BENCH_KEY_SIZE], BENCH_KEY_SIZE, "key_%u_%d", bench_random(100000), i);
+		}
+
+		char corpus[32], names[3][32];
+		snprintf(corpus, sizeof corpus, "map%d", count);
+		snprintf(names[0], sizeof names[0], "hashmap_set");
+		snprintf(names[1], sizeof names[1], "hashmap_get");
+		snprintf(names[2], sizeof names[2], "hashmap_remove");
+		struct bench_result set = { corpus, names[0], 0, (size_t)count * maps, maps, .peak_kb = -1 },
+			get = { corpus, names[1], 0, (size_t)count * maps, maps, .peak_kb = -1 },
+			remove = { corpus, names[2], 0, (size_t)count * maps, maps, .peak_kb = -1 };
+		double sum = 0;
+		for (int r = 0; r < options->repeats; r++)
+		{
+			struct bench_sample sample;
+			bench_sample_start(&sample);
+			for (int m = 0; m < maps; m++)
+			{
+				map[m] = hashmap_create();
+				for (int i = 0; i < count; i++)
+				{
+					hashmap_set(map[m], &keys[i * BENCH_KEY_SIZE], (value_t) { .type = TYPE_NUMBER, .data.number = i });
+				}
+			}
+			bench_sample_stop(&sample);
+			bench_sample_keep(&set, &sample);
+
+			bench_sample_start(&sample);
+			for (int m = 0; m < maps; m++)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					sum += hashmap_get(map[m], &keys[(int)((i * 40503ll) % count) * BENCH_KEY_SIZE]).data.number;
+				}
+			}
+			bench_sample_stop(&sample);
+			bench_sample_keep(&get, &sample);
+
+			bench_sample_start(&sample);
+			for (int m = 0; m < maps; m++)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					hashmap_remove(map[m], &keys[i * BENCH_KEY_SIZE]);
+				}
+				hashmap_destroy(map[m]);
+			}
+			bench_sample_stop(&sample);
+			bench_sample_keep(&remove, &sample);
+		}
+		assert(sum >= 0);
+		bench_report(options, &set);
+		bench_report(options, &get);
+		bench_report(options, &remove);
+		free(map);
+		free(keys);
+	}
+}
+
+/*	compares the ns_per_value of every result in the JSON lines at current against the same corpus and op at baseline.
+	Returns how many got slower by more than threshold percent */
+static int bench_compare(const char* current, const char* baseline, double threshold)
+{
+	file_view_t views[2];
+	if (!file_view_open(current, &views[0]))
+	{
+		fprintf(stderr, "bench: can't read %s\n", current);
+		return 1;
+	}
+	if (!file_view_open(baseline, &views[1]))
+	{
+		fprintf(stderr, "bench: can't read %s\n", baseline);
+		file_view_close(&views[0]);
+		return 1;
+	}
+	size_t counts[2];
+	json_state_t* lines[2] = {
+		json_parse_lines_all(views[0].data, views[0].size, JSON_DEFAULT_SETTINGS, 1, &counts[0]),
+		json_parse_lines_all(views[1].data, views[1].size, JSON_DEFAULT_SETTINGS, 1, &counts[1])
+	};
+	path_t corpus = path_compile("/corpus"), op = path_compile("/op"), ns = path_compile("/ns_per_value");
+	assert(lines[0] != NULL && lines[1] != NULL && corpus != NULL && op != NULL && ns != NULL);
+
+	printf("\n%-8s %-14s %12s %12s %8s\n", "corpus", "op", "baseline ns", "current ns", "change");
+	int regressions = 0;
+	for (size_t i = 0; i < counts[0]; i++)
+	{
+		value_t corpus_now, op_now, ns_now;
+		if (lines[0][i].error != JSON_ERROR_NONE || !path_get(corpus, lines[0][i].head, &corpus_now)
+			|| !path_get(op, lines[0][i].head, &op_now) || !path_get(ns, lines[0][i].head, &ns_now))
+		{
+			continue;
+		}
+		for (size_t j = 0; j < counts[1]; j++)
+		{
+			value_t corpus_then, op_then, ns_then;
+			if (lines[1][j].error == JSON_ERROR_NONE && path_get(corpus, lines[1][j].head, &corpus_then)
+				&& path_get(op, lines[1][j].head, &op_then) && path_get(ns, lines[1][j].head, &ns_then)
+				&& strcmp(corpus_now.data.string, corpus_then.data.string) == 0 && strcmp(op_now.data.string, op_then.data.string) == 0)
+			{
+				double change = (ns_now.data.number / ns_then.data.number - 1.0) * 100.0;
+				bool regressed = change > threshold;
+				regressions += regressed;
+				printf("%-8s %-14s %12.2f %12.2f %+7.1f%%%s\n", corpus_now.data.string, op_now.data.string,
+					ns_then.data.number, ns_now.data.number, change, regressed ? "  REGRESSION" : "");
+				break;
+			}
+		}
+	}
+
+	path_destroy(corpus);
+	path_destroy(op);
+	path_destroy(ns);
+	for (int v = 0; v < 2; v++)
+	{
+		for (size_t i = 0; i < counts[v]; i++)
+		{
+			json_destroy_state(&lines[v][i]);
+		}
+		free(lines[v]);
+		file_view_close(&views[v]);
+	}
+	return regressions;
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr,
+		"usage: bench [--size MB] [--repeat N] [--json PATH] [--baseline PATH] [--threshold PERCENT]\n"
+		"       bench --compare\n"
+		"  --size       megabytes of each generated corpus (8)\n"
+		"  --repeat     times each op runs, the best time is kept (3)\n"
+		"  --json       also writes the results as JSON lines to PATH, \"-\" for stdout alone\n"
+		"  --baseline   JSON lines of an earlier run, exits with 1 if an op got slower per value by more than the threshold\n"
+		"  --threshold  percent slower that counts as a regression (10)\n"
+		"  --compare    runs the component comparisons instead of the suite\n");
+}
+
+int main(int argc, char* argv[])
+{
+	struct bench_options options = { .size = 8 * 1000 * 1000, .repeats = 3, .table = true };
+	const char* json_path = NULL, * baseline = NULL;
+	double threshold = 10.0;
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--compare") == 0)
+		{
+			bench_scan_string();
+			bench_parse_indexed();
+			bench_numbers();
+			bench_write_numbers();
+			bench_events();
+			bench_stream();
+			bench_parse_n();
+			bench_lines();
+			bench_concurrent();
+			bench_hashmap();
+			bench_tape();
+			bench_lazy();
+			bench_path();
+			bench_intern();
+			bench_writer();
+			return 0;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && has_value)
+		{
+			options.size = (size_t)(atof(argv[++i]) * 1000 * 1000);
+		}
+		else if (strcmp(argv[i], "--repeat") == 0 && has_value)
+		{
+			options.repeats = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--json") == 0 && has_value)
+		{
+			json_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && has_value)
+		{
+			baseline = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && has_value)
+		{
+			threshold = atof(argv[++i]);
+		}
+		else
+		{
+			bench_usage();
+			return 2;
+		}
+	}
+	if (options.size == 0 || options.repeats <= 0)
+	{
+		bench_usage();
+		return 2;
+	}
+
+	/* comparing needs the results in a file, a temporary one when they weren't asked for */
+	char temporary[] = "bench-XXXXXX";
+	if (json_path != NULL && strcmp(json_path, "-") == 0)
+	{
+		options.json = stdout;
+		options.table = false;
+	}
+	else if (json_path != NULL)
+	{
+		options.json = fopen(json_path, "w");
+	}
+	else if (baseline != NULL)
+	{
+		int fd = mkstemp(temporary);
+		options.json = fd >= 0 ? fdopen(fd, "w") : NULL;
+		json_path = temporary;
+	}
+	if (json_path != NULL && options.json == NULL)
+	{
+		fprintf(stderr, "bench: can't write %s\n", json_path);
+		return 2;
+	}
+
+	if (options.table)
+	{
+		printf("%-8s %-14s %9s %9s %12s %12s\n", "corpus", "op", "MB/s", "ns/value", "allocs/doc", "peak RSS KiB");
+	}
+	for (int c = 0; c < sizeof bench_corpora / sizeof * bench_corpora; c++)
+	{
+		bench_suite_corpus(&options, &bench_corpora[c]);
+	}
+	bench_suite_hashmap(&options);
+
+	int regressions = 0;
+	if (options.json != NULL && options.json != stdout)
+	{
+		fclose(options.json);
+		if (baseline != NULL)
+		{
+			regressions = bench_compare(json_path, baseline, threshold);
+			printf("%d regression%s over %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+		}
+		if (json_path == temporary)
+		{
+			remove(temporary);
+		}
+	}
+	return regressions > 0;
+}
+#endif
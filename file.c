@@ -0,0 +1,258 @@
+/*
+	file.c ~ RL
+	Read-only views of whole files.
+*/
+
+#ifndef _WIN32
+#define _DEFAULT_SOURCE /* mmap, madvise and fdopen are POSIX */
+#endif
+#include "file.h"
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define FILE_READ_SIZE (1 << 16)
+#define FILE_PATH_SIZE 4096
+
+/* empty files have nothing to map, they get a view of this instead */
+static const char file_empty[1];
+
+/* reads f to its end into a buffer that doubles as needed, for files whose size can't be known up front */
+static bool file_view_read(FILE* f, file_view_t* view)
+{
+	size_t size = 0,
+		reserved = FILE_READ_SIZE;
+	char* data = malloc(reserved);
+	if (data == NULL)
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		size_t count = fread(data + size, 1, reserved - size, f);
+		size += count;
+		if (count == 0)
+		{
+			break;
+		}
+		if (size == reserved)
+		{
+			char* new = realloc(data, reserved * 2);
+			if (new == NULL)
+			{
+				free(data);
+				return false;
+			}
+			data = new;
+			reserved *= 2;
+		}
+	}
+
+	if (ferror(f))
+	{
+		free(data);
+		return false;
+	}
+	*view = (file_view_t){ .data = data, .size = size };
+	return true;
+}
+
+#ifdef _WIN32
+bool file_view_open(const char* path, file_view_t* view)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > SIZE_MAX)
+	{
+		CloseHandle(file);
+		FILE* f = fopen(path, "rb");
+		if (f == NULL)
+		{
+			return false;
+		}
+		bool result = file_view_read(f, view);
+		fclose(f);
+		return result;
+	}
+
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		*view = (file_view_t){ .data = file_empty, .mapped = true };
+		return true;
+	}
+
+	/* the view keeps the mapping alive after both handles are closed */
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+	{
+		return false;
+	}
+	const char* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == NULL)
+	{
+		return false;
+	}
+
+	*view = (file_view_t){ .data = data, .size = (size_t)size.QuadPart, .mapped = true };
+	return true;
+}
+
+void file_view_close(file_view_t* view)
+{
+	if (view->mapped && view->data != file_empty)
+	{
+		UnmapViewOfFile(view->data);
+	}
+	else if (!view->mapped)
+	{
+		free((char*)view->data);
+	}
+	*view = (file_view_t){ 0 };
+}
+
+bool file_is_directory(const char* path)
+{
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool file_list(const char* directory, bool (*each)(void* user, const char* path), void* user)
+{
+	char path[FILE_PATH_SIZE];
+	if (snprintf(path, sizeof path, "%s\\*", directory) >= (int)sizeof path)
+	{
+		return false;
+	}
+
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA(path, &found);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	bool result = true;
+	do
+	{
+		if (!(found.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_DEVICE))
+			&& snprintf(path, sizeof path, "%s\\%s", directory, found.cFileName) < (int)sizeof path)
+		{
+			result = each(user, path);
+		}
+	} while (result && FindNextFileA(find, &found));
+	FindClose(find);
+	return result;
+}
+#else
+bool file_view_open(const char* path, file_view_t* view)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (uint64_t)info.st_size > SIZE_MAX)
+	{
+		/* pipes, terminals and the like are read as they come */
+		FILE* f = fdopen(fd, "rb");
+		if (f == NULL)
+		{
+			close(fd);
+			return false;
+		}
+		bool result = file_view_read(f, view);
+		fclose(f);
+		return result;
+	}
+
+	if (info.st_size == 0)
+	{
+		close(fd);
+		*view = (file_view_t){ .data = file_empty, .mapped = true };
+		return true;
+	}
+
+	/* the mapping outlives the descriptor */
+	size_t size = (size_t)info.st_size;
+	void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	/* hints only, parsing reads the file front to back exactly once */
+#ifdef MADV_SEQUENTIAL
+	madvise(data, size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+	madvise(data, size, MADV_HUGEPAGE);
+#endif
+
+	*view = (file_view_t){ .data = data, .size = size, .mapped = true };
+	return true;
+}
+
+void file_view_close(file_view_t* view)
+{
+	if (view->mapped && view->data != file_empty)
+	{
+		munmap((void*)view->data, view->size);
+	}
+	else if (!view->mapped)
+	{
+		free((char*)view->data);
+	}
+	*view = (file_view_t){ 0 };
+}
+
+bool file_is_directory(const char* path)
+{
+	struct stat info;
+	return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool file_list(const char* directory, bool (*each)(void* user, const char* path), void* user)
+{
+	DIR* dir = opendir(directory);
+	if (dir == NULL)
+	{
+		return false;
+	}
+
+	bool result = true;
+	char path[FILE_PATH_SIZE];
+	for (struct dirent* entry; result && (entry = readdir(dir)) != NULL;)
+	{
+		struct stat info;
+		if (snprintf(path, sizeof path, "%s/%s", directory, entry->d_name) < (int)sizeof path
+			&& stat(path, &info) == 0 && S_ISREG(info.st_mode))
+		{
+			result = each(user, path);
+		}
+	}
+	closedir(dir);
+	return result;
+}
+#endif
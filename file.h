@@ -0,0 +1,28 @@
+/*
+	file.h ~ RL
+	Read-only views of whole files.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct file_view
+{
+	const char* data; /* the file's bytes, not terminated */
+	size_t size;
+	bool mapped; /* data is the file mapped into memory rather than a copy read from it */
+} file_view_t;
+
+/*	maps the file at path into memory read-only. Files that can't be mapped, such as pipes, are read into memory instead.
+	Returns false on failure */
+bool file_view_open(const char* path, file_view_t* view);
+/* unmaps or frees the view's data */
+void file_view_close(file_view_t* view);
+
+/* whether path names a directory */
+bool file_is_directory(const char* path);
+/*	calls each with the path of every regular file directly inside directory, in no particular order.
+	Stops when each returns false. Returns false if the directory can't be read or each stopped */
+bool file_list(const char* directory, bool (*each)(void* user, const char* path), void* user);
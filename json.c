@@ -3,30 +3,23 @@
 */
 
 #include "json.h"
-#include <ctype.h>
 #include <malloc.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <threads.h>
+#include "number.h"
+#include "pool.h"
+#include "scan.h"
 #include "util.h"
 
 #define START_STR_SIZE 8
-
-json_settings_t settings = JSON_CHECK_BOM;
-
-static inline void* json_realloc_with_zeros(const void* ptr, size_t old_size, size_t new_size)
-{
-	void* res = malloc(new_size);
-	if (res == NULL)
-	{
-		return NULL;
-	}
-
-	memcpy(res, ptr, old_size);
-	memset((char*)res + old_size, 0, new_size - old_size);
-
-	return res;
-}
+#define JSON_INDEX_WINDOW (64 * 1024) /* bytes indexed at a time by json_parse_indexed */
+#define JSON_SMALL_DOCUMENT (16 * 1024)
+#define JSON_SMALL_ARENA_BLOCK (16 * 1024)
+#define JSON_LINES_CHUNK (1 << 20)
+#define JSON_LINES_WINDOW 4 /* chunks each worker may be ahead of the handler */
 
 static json_error_t json_parse_escape(const char** praw, char** pcurr)
 {
@@ -106,488 +99,1699 @@ static json_error_t json_parse_escape(const char** praw, char** pcurr)
 	return JSON_ERROR_NONE;
 }
 
-static json_error_t json_parse_string(const char** praw, char** res)
+/* on failure str is left untouched and still has to be freed by the caller */
+static inline char* json_grow_string(arena_t arena, const allocator_t* allocator, alloc_kind_t kind, char* str, size_t old_size, size_t new_size)
+{
+	if (arena == NULL)
+	{
+		return allocator_realloc(allocator, str, str != NULL ? old_size : 0, new_size, kind);
+	}
+
+	/* the string being parsed is always the arena's last allocation, so this is normally an in-place bump */
+	return arena_realloc(arena, str, old_size, new_size);
+}
+
+/*	in_situ strings are decoded over their own source bytes, which works since decoded output is never longer than
+	its escape sequences. Escape-free strings are not copied at all, the closing quote is replaced with a terminator.
+	end is where the document ends when it isn't at the first terminator, making any terminator before it part of the string.
+	Without an arena the string is allocated from allocator as kind */
+static json_error_t json_parse_string(const char** praw, char** res, arena_t arena, const allocator_t* allocator, alloc_kind_t kind, bool in_situ, const char* end)
 {
+#define FAIL(err) { if (arena == NULL && !in_situ) { allocator_free(allocator, *res, kind); } return err; }
 	/* advance one since **praw is equal to " */
 	const char* raw = (*praw) + 1;
-	size_t str_size = START_STR_SIZE;
-	*res = calloc(str_size, sizeof ** res);
-	char* curr = *res;
-	if (*res == NULL)
+	size_t str_size = 0;
+	*res = NULL;
+	if (in_situ)
 	{
-		return JSON_ERROR_SYSTEM;
+		*res = (char*)raw;
+		str_size = SIZE_MAX;
 	}
+	char* curr = *res;
 
-	for (; *raw && *raw != '"'; raw++)
+	for (;;)
 	{
-		if ((int)(curr - *res) >= str_size - 2) /* allow for 2 extra bytes at the end of *res for \UXXXX escape sequences */
+		/* copy everything up to the next quote, escape or control character in one go */
+		const char* stop = scan_string(raw);
+		size_t run = (size_t)(stop - raw),
+			used = *res != NULL ? (size_t)(curr - *res) : 0;
+		if (used + run + 3 > str_size) /* allow for the run, 2 bytes of a \UXXXX escape sequence and the terminator */
 		{
-			char* new = json_realloc_with_zeros(*res, str_size, str_size * 2);
+			size_t new_size = str_size * 2 > used + run + 3 ? str_size * 2 : used + run + 3;
+			if (new_size < START_STR_SIZE)
+			{
+				new_size = START_STR_SIZE;
+			}
+			char* new = json_grow_string(arena, allocator, kind, *res, str_size, new_size);
 			if (new == NULL)
 			{
-				free(*res);
-				return JSON_ERROR_SYSTEM;
+				FAIL(JSON_ERROR_SYSTEM);
 			}
-			str_size *= 2;
-			curr = curr - *res + new;
+			str_size = new_size;
+			curr = new + used;
 			*res = new;
 		}
 
-		if (*raw == '\b'
-			|| *raw == '\f'
-			|| *raw == '\n'
-			|| *raw == '\r'
-			|| *raw == '\t')
+		if (curr != raw)
+		{
+			memmove(curr, raw, run);
+		}
+		curr += run;
+		raw = stop;
+
+		if (*raw == '"')
+		{
+			break;
+		}
+
+		if (*raw == '\0')
 		{
-			free(*res);
-			return JSON_ERROR_UNESCAPED_CONTROL_CHARACTER;
+			FAIL(end != NULL && raw < end ? JSON_ERROR_NULL_TERMINATOR : JSON_ERROR_UNEXPECTED_TOKEN); /* unterminated when at the end */
 		}
 
 		if (*raw != '\\')
 		{
-			*curr++ = *raw;
-			continue;
+			FAIL(JSON_ERROR_UNESCAPED_CONTROL_CHARACTER);
 		}
 
 		json_error_t escape_result = json_parse_escape(&raw, &curr);
 		if (escape_result != JSON_ERROR_NONE)
 		{
-			free(*res);
-			return escape_result;
+			FAIL(escape_result);
 		}
+		raw++;
 	}
+	*curr = '\0';
 	*praw = raw;
 	return JSON_ERROR_NONE;
+#undef FAIL
 }
 
-static double json_string_to_number(const char** praw)
+/*	reads the number at *praw into out, as a TYPE_INTEGER or TYPE_UINTEGER when integers is set and it is one,
+	otherwise a TYPE_NUMBER */
+static json_error_t json_parse_number(const char** praw, value_t* out, bool integers)
 {
-	double sign = 1.0, res = 0.0;
-	const char* raw = *praw;
-	if (*raw == '-')
+	static const json_error_t errors[NUMBER_STATUS_COUNT] =
 	{
-		sign = -1.0;
-		raw++;
+		[NUMBER_OK] = JSON_ERROR_NONE,
+		[NUMBER_NO_DIGITS] = JSON_ERROR_INVALID_NUMBER,
+		[NUMBER_LEADING_ZERO] = JSON_ERROR_LEADING_ZERO,
+		[NUMBER_MISSING_FRACTION] = JSON_ERROR_UNEXPECTED_TOKEN,
+		[NUMBER_MISSING_EXPONENT] = JSON_ERROR_UNEXPECTED_TOKEN
+	};
+
+	const char* end;
+	number_status_t status = integers ? number_scan_integer(*praw, &out->data.integer, &out->data.uinteger, &end) : NUMBER_NOT_INTEGER;
+	if (status == NUMBER_OK || status == NUMBER_UNSIGNED)
+	{
+		out->type = status == NUMBER_OK ? TYPE_INTEGER : TYPE_UINTEGER;
+	}
+	else if (status == NUMBER_NOT_INTEGER)
+	{
+		number_decimal_t decimal;
+		status = number_scan(*praw, &decimal, &end);
+		if (status != NUMBER_OK)
+		{
+			return errors[status];
+		}
+		*out = (value_t){ .type = TYPE_NUMBER, .data.number = number_to_double(decimal, *praw, (size_t)(end - *praw)) };
+	}
+	else
+	{
+		return errors[status];
 	}
+	*praw = end - 1; /* back one so that we dont skip a character when json_parse increments */
+	return JSON_ERROR_NONE;
+}
+
+enum json_expectation
+{
+	COMMA =		0x01,
+	COLON =		0x02,
+	SQUIGGLY =	0x04,
+	SQUARE =	0x08,
+
+	NEXT_ITEM_EXPECTATION = COMMA | SQUIGGLY | SQUARE,
+	DELIMITER =	COMMA | COLON | SQUIGGLY | SQUARE,
+
+	KEY =		0x10,
+	VALUE =		0x20
+};
+
+struct json_parser
+{
+	json_state_t doc;
+	const char* begin;
+	size_t offset; /* position of begin in the document, only json_stream parses a document from more than one buffer */
+	const char* end; /* end of the buffer being parsed when the document isn't terminated, otherwise NULL */
+	/*	open containers. While building, each is a frame of its type whose data.integer is where its elements start in
+		values, and the root is replaced by the finished document */
+	array_t stack;
+	array_t values; /* elements of every open container, keys and values alternating for objects */
+	hashmap_t interned; /* the one copy of each interned string, created on first use */
+	const allocator_t* containers; /* where objects and arrays come from, the arena's allocator when there is an arena */
+	int indent;
+	bool in_situ;
+	enum json_expectation expectation;
+	json_event_handler handler; /* set by json_parse_events, the document is reported to it instead of being built */
+	void* user;
+};
+
+/*	arena_block is the size of the arena's blocks when the document gets one, 0 for the default. Everything the parser
+	allocates comes from allocator, which may be NULL */
+static bool json_parser_init(struct json_parser* parser, const char* raw, json_settings_t parse_settings, size_t arena_block, const allocator_t* allocator)
+{
+	*parser = (struct json_parser){
+		.doc = { .error = JSON_ERROR_NONE, .settings = parse_settings, .allocator = allocator },
+		.containers = allocator,
+		.begin = raw,
+		.in_situ = (parse_settings & JSON_IN_SITU) != 0,
+		.expectation = VALUE
+	};
 
-	char prev = 0;
-	for (; *raw >= '0' && *raw <= '9'; raw++)
+	if (parse_settings & JSON_USE_ARENA)
 	{
-		if (prev == '0' && *raw != '0')
+		parser->doc.arena = arena_create_with(arena_block, allocator);
+		if (parser->doc.arena == NULL)
 		{
-			return JSON_ERROR_LEADING_ZERO;
+			parser->doc.error = JSON_ERROR_SYSTEM;
+			return false;
 		}
-		prev = *raw;
-		res = res * 10 + *raw - '0';
+		parser->containers = arena_allocator(parser->doc.arena);
 	}
 
-	if (sign == -1.0 && raw - 1 == *praw) /* checks against strings like "-" */
+	parser->stack = array_create_with(allocator, 0);
+	parser->values = array_create_with(allocator, 0);
+	if (parser->stack == NULL || parser->values == NULL)
 	{
-		return 0.0;
+		parser->doc.error = JSON_ERROR_SYSTEM;
+		return false;
 	}
+	return true;
+}
 
-	*praw = raw;
-	return res * sign;
+/* how the strings and keys of a value being destroyed are freed */
+struct json_destroy_strings
+{
+	bool owned; /* false when they point into a buffer parsed in situ */
+	const allocator_t* allocator;
+};
+
+static void json_destroy_value(value_t head, const struct json_destroy_strings* strings);
+
+#ifdef JSON_STATS
+#define JSON_STAT(statement) statement
+
+static inline void json_stats_open(json_stats_t* stats, int depth)
+{
+	stats->max_depth = depth > stats->max_depth ? depth : stats->max_depth;
 }
 
-static json_error_t json_parse_number(const char** praw, double* out, bool recursive)
+static inline void json_stats_object(json_stats_t* stats, const hashmap_t map)
 {
-	*out = 0.0;
-	const char* raw = *praw;
+	hashmap_stats_t map_stats = hashmap_stats(map);
+	stats->hashmap_resizes += map_stats.resizes;
+	stats->probes += map_stats.probes;
+	stats->longest_probe = map_stats.longest_probe > stats->longest_probe ? map_stats.longest_probe : stats->longest_probe;
+}
+#else
+#define JSON_STAT(statement)
+#endif
 
-	*out = json_string_to_number(&raw);
-	if (*raw == '.')
+/* frees the parser's working state, and the document too if parsing failed */
+static json_state_t json_parser_release(struct json_parser* parser)
+{
+#ifdef JSON_STATS
+	if (parser->doc.error == JSON_ERROR_NONE && parser->handler == NULL)
 	{
-		raw++;
-		const char* start = raw;
-		*out += json_string_to_number(&raw) / pow(10.0, (double)(raw - start));
-		if (start == raw)
+		parser->doc.stats.bytes = parser->doc.arena != NULL ? arena_memory_usage(parser->doc.arena) : json_memory_usage(parser->doc.head);
+	}
+#endif
+	if (parser->doc.error != JSON_ERROR_NONE && parser->doc.arena == NULL && parser->handler == NULL)
+	{
+		/*	the values finished before the error were never handed out. While containers are open the stack only
+			holds their frames, each owning the values from its start to the next frame's, keys first for objects.
+			Otherwise it holds the root */
+		struct json_destroy_strings strings = { .owned = !parser->in_situ, .allocator = parser->doc.allocator };
+		for (int frame = 0; parser->stack != NULL && parser->values != NULL && parser->indent > 0 && frame < array_count(parser->stack); frame++)
+		{
+			value_t open = array_get(parser->stack, frame);
+			int start = (int)open.data.integer,
+				end = frame + 1 < array_count(parser->stack) ? (int)array_get(parser->stack, frame + 1).data.integer : array_count(parser->values);
+			for (int i = start; i < end; i++)
+			{
+				value_t element = array_get(parser->values, i);
+				if (open.type == TYPE_OBJECT && (i - start) % 2 == 0)
+				{
+					if (strings.owned)
+					{
+						allocator_free(strings.allocator, element.data.string, ALLOC_KEY);
+					}
+				}
+				else
+				{
+					json_destroy_value(element, &strings);
+				}
+			}
+		}
+		for (int i = 0; parser->stack != NULL && parser->indent == 0 && i < array_count(parser->stack); i++)
 		{
-			return JSON_ERROR_UNEXPECTED_TOKEN;
+			json_destroy_value(array_get(parser->stack, i), &strings);
 		}
 	}
-	if (*raw == 'e' || *raw == 'E')
+	if (parser->stack != NULL)
 	{
-		raw++;
-		if (*raw == '+')
+		array_destroy(parser->stack);
+	}
+	if (parser->values != NULL)
+	{
+		array_destroy(parser->values);
+	}
+	if (parser->interned != NULL)
+	{
+		hashmap_destroy(parser->interned); /* the strings are the document's */
+	}
+	if (parser->doc.error != JSON_ERROR_NONE && parser->doc.arena != NULL)
+	{
+		arena_destroy(parser->doc.arena);
+		parser->doc.arena = NULL;
+	}
+	return parser->doc;
+}
+
+/* releases a parser used for events, whose arena was only scratch space for strings */
+static json_state_t json_parser_release_events(struct json_parser* parser)
+{
+	json_state_t doc = json_parser_release(parser);
+	if (doc.arena != NULL)
+	{
+		arena_destroy(doc.arena);
+		doc.arena = NULL;
+	}
+	doc.head = (value_t){ .type = TYPE_NULL };
+	doc.settings &= ~JSON_USE_ARENA;
+	return doc;
+}
+
+/*	a key repeated in an object keeps its first copy and its last value, the other copies and values were only held
+	by values. Frees them when the object's count pairs at elements are done being set */
+static void json_destroy_shadowed(const struct json_parser* parser, const value_t* elements, int count)
+{
+	struct json_destroy_strings strings = { .owned = !parser->in_situ, .allocator = parser->doc.allocator };
+	for (int i = 0; i < count; i += 2)
+	{
+		for (int j = i + 2; j < count; j += 2)
 		{
-			raw++;
+			if (strcmp(elements[i].data.string, elements[j].data.string) == 0)
+			{
+				json_destroy_value(elements[i + 1], &strings);
+				break;
+			}
 		}
-		const char* start = raw;
-		*out *= pow(10.0, json_string_to_number(&raw));
-		if (start == raw)
+	}
+	/* last to first, so the keys compared against are never ones already freed */
+	for (int i = count - 2; i > 0 && strings.owned; i -= 2)
+	{
+		for (int j = 0; j < i; j += 2)
 		{
-			return JSON_ERROR_UNEXPECTED_TOKEN;
+			if (strcmp(elements[i].data.string, elements[j].data.string) == 0)
+			{
+				allocator_free(strings.allocator, elements[i].data.string, ALLOC_KEY);
+				break;
+			}
 		}
 	}
+}
 
-	*praw = raw - 1; /* back one so that we dont skip a character when json_parse increments */
-	return JSON_ERROR_NONE;
+/*	each interned string is stored in the document's arena after its hashmap_key_hash, so objects can be built without
+	hashing their keys again */
+#define JSON_INTERN_HASH_SIZE sizeof(uint32_t)
+
+static inline uint32_t json_interned_hash(const char* str)
+{
+	uint32_t hash;
+	memcpy(&hash, str - JSON_INTERN_HASH_SIZE, sizeof hash);
+	return hash;
 }
 
-json_state_t json_parse(const char* raw)
+/*	replaces *pstr, just decoded by json_parse_string, with the document's copy of it, making that copy if it is new.
+	Outside of in situ parsing *pstr is the arena's last allocation, which is then given back or reused for the copy */
+static bool json_intern(struct json_parser* parser, char** pstr)
 {
-#define GUARD(condition, err) if (!(condition)) { array_destroy(stack); doc.error = err; doc.pos = (int)(raw - begin); return doc; }
-	json_state_t doc = { .error = JSON_ERROR_NONE, .settings = settings };
-	const char* begin = raw;
-	int indent = 0;
-	array_t stack = array_create();
-	enum
+	if (parser->interned == NULL)
 	{
-		COMMA =		0x01,
-		COLON =		0x02,
-		SQUIGGLY =	0x04,
-		SQUARE =	0x08,
-		
-		NEXT_ITEM_EXPECTATION = COMMA | SQUIGGLY | SQUARE,
-		DELIMITER =	COMMA | COLON | SQUIGGLY | SQUARE,
+		parser->interned = hashmap_create_with(parser->doc.allocator, 0);
+		if (parser->interned == NULL)
+		{
+			return false;
+		}
+	}
 
-		KEY =		0x10,
-		VALUE =		0x20
-	} expectation = VALUE;
+	char* str = *pstr;
+	size_t length = strlen(str);
+	uint32_t hash = hashmap_key_hash(str);
+	value_t interned;
+	if (hashmap_get_hashed(parser->interned, str, hash, &interned))
+	{
+		if (!parser->in_situ)
+		{
+			arena_realloc(parser->doc.arena, str, length + 1, 0);
+		}
+		*pstr = interned.data.string;
+		return true;
+	}
 
-	GUARD(stack != NULL, JSON_ERROR_SYSTEM);
+	char* copy;
+	if (parser->in_situ)
+	{
+		copy = arena_alloc(parser->doc.arena, JSON_INTERN_HASH_SIZE + length + 1);
+		if (copy == NULL)
+		{
+			return false;
+		}
+		memcpy(copy + JSON_INTERN_HASH_SIZE, str, length + 1);
+	}
+	else
+	{
+		copy = arena_realloc(parser->doc.arena, str, length + 1, JSON_INTERN_HASH_SIZE + length + 1);
+		if (copy == NULL)
+		{
+			return false;
+		}
+		memmove(copy + JSON_INTERN_HASH_SIZE, copy, length + 1);
+	}
+	memcpy(copy, &hash, sizeof hash);
+	*pstr = copy + JSON_INTERN_HASH_SIZE;
+	return hashmap_set_hashed(parser->interned, *pstr, hash, (value_t) { .type = TYPE_STRING, .data.string = *pstr });
+}
 
-	for (; *raw; raw++)
+/*	parses the token starting at *praw, leaving *praw on its last byte. Whitespace is a token of its own.
+	Returns false and sets the parser's error and position on failure */
+static inline bool json_parse_token(struct json_parser* parser, const char** praw)
+{
+#define GUARD(condition, err) if (!(condition)) { parser->doc.error = err; parser->doc.pos = (int)(parser->offset + (size_t)(raw - parser->begin)); return false; }
+#define EMIT(event, val) GUARD(parser->handler(parser->user, event, val), JSON_ERROR_ABORTED)
+	const char* raw = *praw;
+	array_t stack = parser->stack;
+	value_t next;
+	bool key = false;
+	switch (*raw)
+	{
+	case '/':
 	{
-		value_t next;
-		switch (*raw)
+		GUARD(parser->doc.settings & JSON_ALLOW_COMMENTS, JSON_ERROR_COMMENTS_DISABLED);
+		raw++;
+		GUARD(*raw == '/' || *raw == '*', JSON_ERROR_UNEXPECTED_TOKEN);
+		if (*raw == '/')
 		{
-		case '/':
+			for (; raw[1] && raw[1] != '\n'; raw++); /* stop on the comment's last byte, a terminator must not be skipped */
+		}
+		else if (*raw == '*')
 		{
-			GUARD(doc.settings & JSON_ALLOW_COMMENTS, JSON_ERROR_COMMENTS_DISABLED);
 			raw++;
-			if (*raw == '/')
-			{
-				for (; *raw && *raw != '\n'; raw++);
-			}
-			else if (*raw == '*')
-			{
-				char prev = *raw++;
-				for (; *raw && !(prev == '*' && *raw == '/'); raw++);
-				GUARD(*raw, JSON_ERROR_UNEXPECTED_TOKEN);
-			}
-			continue;
+			char prev = 0;
+			for (; *raw && !(prev == '*' && *raw == '/'); prev = *raw++);
+			GUARD(*raw, JSON_ERROR_UNEXPECTED_TOKEN);
 		}
+		*praw = raw;
+		return true;
+	}
 
-		case '\"':
+	case '\"':
+	{
+		GUARD(parser->expectation & (KEY | VALUE), JSON_ERROR_UNEXPECTED_TOKEN);
+		key = (parser->expectation & KEY) != 0;
+
+		char* str;
+		json_error_t err = json_parse_string(&raw, &str, parser->doc.arena, parser->doc.allocator, key ? ALLOC_KEY : ALLOC_STRING, parser->in_situ, parser->end);
+		GUARD(err == JSON_ERROR_NONE, err);
+		JSON_STAT(*(key ? &parser->doc.stats.keys : &parser->doc.stats.strings) += 1);
+		JSON_STAT(parser->doc.stats.string_bytes += strlen(str));
+		if (parser->handler == NULL && parser->doc.arena != NULL
+			&& parser->doc.settings & (key ? JSON_INTERN_KEYS : JSON_INTERN_STRINGS)
+			&& (key || strlen(str) <= JSON_INTERN_STRING_LENGTH))
 		{
-			GUARD(expectation & (KEY | VALUE), JSON_ERROR_UNEXPECTED_TOKEN);
+			GUARD(json_intern(parser, &str), JSON_ERROR_SYSTEM);
+		}
 
-			char* str;
-			doc.error = json_parse_string(&raw, &str);
-			GUARD(doc.error == JSON_ERROR_NONE, doc.error);
+		next = (value_t) { .type = TYPE_STRING, .data.string = str };
 
-			next = (value_t) { .type = TYPE_STRING, .data.string = str };
+		parser->expectation = key ? COLON : NEXT_ITEM_EXPECTATION;
+		break;
+	}
 
-			expectation = DELIMITER;
-			break;
-		}
+	case '{':
+	{
+		GUARD(parser->expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
 
-		case '{':
+		next = (value_t) { .type = TYPE_OBJECT, .data.integer = array_count(parser->values) };
+		GUARD(array_push(stack, next), JSON_ERROR_SYSTEM);
+		JSON_STAT(parser->doc.stats.objects++);
+		JSON_STAT(json_stats_open(&parser->doc.stats, parser->indent + 1));
+		if (parser->handler != NULL)
 		{
-			GUARD(expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
+			EMIT(JSON_EVENT_START_OBJECT, (value_t) { .type = TYPE_OBJECT });
+		}
 
-			next = (value_t) { .type = TYPE_OBJECT, .data.object = hashmap_create() };
-			GUARD(next.data.object != NULL && array_push(stack, next), JSON_ERROR_SYSTEM);
+		parser->indent++;
+		parser->expectation = KEY | SQUIGGLY;
+		return true;
+	}
 
-			indent++;
-			expectation = KEY | SQUIGGLY;
-			continue;
-		}
+	case '[':
+	{
+		GUARD(parser->expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
 
-		case '[':
+		next = (value_t) { .type = TYPE_ARRAY, .data.integer = array_count(parser->values) };
+		GUARD(array_push(stack, next), JSON_ERROR_SYSTEM);
+		JSON_STAT(parser->doc.stats.arrays++);
+		JSON_STAT(json_stats_open(&parser->doc.stats, parser->indent + 1));
+		if (parser->handler != NULL)
 		{
-			GUARD(expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
+			EMIT(JSON_EVENT_START_ARRAY, (value_t) { .type = TYPE_ARRAY });
+		}
 
-			next = (value_t) { .type = TYPE_ARRAY, .data.array = array_create() };
-			GUARD(next.data.array != NULL && array_push(stack, next), JSON_ERROR_SYSTEM);
+		parser->indent++;
+		parser->expectation = VALUE | SQUARE;
+		return true;
+	}
 
-			indent++;
-			expectation = VALUE | SQUARE;
-			continue;
+	case 't':
+	case 'f':
+	case 'n':
+	{
+		GUARD(parser->expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
+		next = (value_t) { .type = TYPE_BOOLEAN };
+		if (strncmp("true", raw, 4) == 0)
+		{
+			next.data.boolean = true;
+			raw += 3;
 		}
-
-		case 't':
-		case 'f':
-		case 'n':
+		else if (strncmp("false", raw, 5) == 0)
 		{
-			GUARD(expectation & VALUE, JSON_ERROR_UNEXPECTED_TOKEN);
-			next = (value_t) { .type = TYPE_BOOLEAN };
-			if (strncmp("true", raw, 4) == 0)
-			{
-				next.data.boolean = true;
-				raw += 3;
-			}
-			else if (strncmp("false", raw, 5) == 0)
-			{
-				next.data.boolean = false;
-				raw += 4;
-			}
-			else if (strncmp("null", raw, 4) == 0)
-			{
-				next.type = TYPE_NULL;
-				raw += 3;
-			}
-			else
-			{
-				GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
-			}
-
-			expectation = NEXT_ITEM_EXPECTATION;
-			break;
+			next.data.boolean = false;
+			raw += 4;
 		}
-
-		case ',':
+		else if (strncmp("null", raw, 4) == 0)
 		{
-			GUARD(expectation & COMMA && array_count(stack) > 0, JSON_ERROR_UNEXPECTED_TOKEN);
-			if (ARRAY_TOP(stack).type == TYPE_ARRAY)
-			{
-				expectation = VALUE;
-			}
-			else if (ARRAY_TOP(stack).type == TYPE_OBJECT)
-			{
-				expectation = KEY;
-			}
-			else
-			{
-				GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
-			}
-
-			continue;
+			next.type = TYPE_NULL;
+			raw += 3;
 		}
-
-		case ':':
+		else
 		{
-			GUARD(expectation & COLON && array_count(stack) > 0 && ARRAY_TOP(stack).type == TYPE_OBJECT, JSON_ERROR_UNEXPECTED_TOKEN);
-			expectation = VALUE;
-			continue;
+			GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
 		}
+		JSON_STAT(parser->doc.stats.literals++);
 
-		case '}':
+		parser->expectation = NEXT_ITEM_EXPECTATION;
+		break;
+	}
+
+	case ',':
+	{
+		GUARD(parser->expectation & COMMA && parser->indent > 0, JSON_ERROR_UNEXPECTED_TOKEN);
+		if (ARRAY_TOP(stack).type == TYPE_ARRAY)
 		{
-			GUARD(expectation & SQUIGGLY, JSON_ERROR_UNEXPECTED_TOKEN);
-			expectation = SQUARE;
-		case ']':
-			GUARD(expectation & SQUARE, JSON_ERROR_UNEXPECTED_TOKEN);
+			parser->expectation = VALUE;
+		}
+		else if (ARRAY_TOP(stack).type == TYPE_OBJECT)
+		{
+			parser->expectation = KEY;
+		}
+		else
+		{
+			GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
+		}
+
+		return true;
+	}
 
+	case ':':
+	{
+		GUARD(parser->expectation & COLON && array_count(stack) > 0 && ARRAY_TOP(stack).type == TYPE_OBJECT, JSON_ERROR_UNEXPECTED_TOKEN);
+		parser->expectation = VALUE;
+		return true;
+	}
+
+	case '}':
+	case ']':
+	{
+		bool object = *raw == '}';
+		GUARD(parser->expectation & (object ? SQUIGGLY : SQUARE) && parser->indent > 0
+			&& ARRAY_TOP(stack).type == (object ? TYPE_OBJECT : TYPE_ARRAY), JSON_ERROR_UNEXPECTED_TOKEN);
+
+		if (parser->handler != NULL)
+		{
+			EMIT(object ? JSON_EVENT_END_OBJECT : JSON_EVENT_END_ARRAY, (value_t) { .type = ARRAY_TOP(stack).type });
 			if (array_count(stack) > 1)
 			{
-				value_t obj = ARRAY_TOP(stack), parent;
 				array_pop(stack);
-				parent = ARRAY_TOP(stack);
-				if (parent.type == TYPE_OBJECT)
+			}
+		}
+		else
+		{
+			/* the container is only created now, at exactly the size of the elements waiting for it */
+			int start = (int)ARRAY_TOP(stack).data.integer,
+				count = array_count(parser->values) - start;
+			const value_t* elements = array_data(parser->values) + start;
+			if (object)
+			{
+				next = (value_t) { .type = TYPE_OBJECT, .data.object = hashmap_create_with(parser->containers, count / 2) };
+				GUARD(next.data.object != NULL, JSON_ERROR_SYSTEM);
+				bool interned = parser->interned != NULL && parser->doc.settings & JSON_INTERN_KEYS;
+				for (int i = 0; i < count; i += 2)
 				{
-					GUARD(hashmap_next_set(parent.data.object, obj), JSON_ERROR_SYSTEM);
+					const char* member = elements[i].data.string;
+					if (!(interned
+						? hashmap_set_hashed(next.data.object, member, json_interned_hash(member), elements[i + 1])
+						: hashmap_set(next.data.object, member, elements[i + 1])))
+					{
+						hashmap_destroy(next.data.object); /* its keys and values are still in values, freed with them */
+						GUARD(false, JSON_ERROR_SYSTEM);
+					}
 				}
-				else
+				if (parser->doc.arena == NULL && hashmap_count(next.data.object) < count / 2)
+				{
+					json_destroy_shadowed(parser, elements, count);
+				}
+				JSON_STAT(json_stats_object(&parser->doc.stats, next.data.object));
+			}
+			else
+			{
+				next = (value_t) { .type = TYPE_ARRAY, .data.array = array_create_with(parser->containers, count) };
+				GUARD(next.data.array != NULL, JSON_ERROR_SYSTEM);
+				for (int i = 0; i < count; i++)
+				{
+					array_push(next.data.array, elements[i]);
+				}
+			}
+			array_truncate(parser->values, start);
+			array_pop(stack);
+			if (!array_push(array_count(stack) > 0 ? parser->values : stack, next))
+			{
+				/* the elements now only live in next, which nothing else will free */
+				if (parser->doc.arena == NULL)
 				{
-					GUARD(array_push(parent.data.array, obj), JSON_ERROR_SYSTEM);
+					json_destroy_value(next, &(struct json_destroy_strings){ .owned = !parser->in_situ, .allocator = parser->doc.allocator });
 				}
+				GUARD(false, JSON_ERROR_SYSTEM);
 			}
+		}
 
-			expectation = NEXT_ITEM_EXPECTATION;
-			indent--;
+		parser->expectation = NEXT_ITEM_EXPECTATION;
+		parser->indent--;
 
-			continue;
-		}
+		return true;
+	}
 
-		case ' ':
-		case '\n':
-		case '\r':
-		case '\t':
-			continue;
+	case ' ':
+	case '\n':
+	case '\r':
+	case '\t':
+		return true;
 
-		default:
+	default:
+	{
+		if (*raw == '-' || (*raw >= '0' && *raw <= '9'))
 		{
-			if (*raw == '-' || (*raw >= '0' && *raw <= '9'))
-			{
-				GUARD(expectation & VALUE, JSON_ERROR_MISC);
+			GUARD(parser->expectation & VALUE, JSON_ERROR_MISC);
 
-				next = (value_t) { .type = TYPE_NUMBER };
-				doc.error = json_parse_number(&raw, &next.data.number, false);
+			json_error_t err = json_parse_number(&raw, &next, parser->doc.settings & JSON_PARSE_INTEGERS);
 
-				GUARD(doc.error == JSON_ERROR_NONE, doc.error);
+			GUARD(err == JSON_ERROR_NONE, err);
+			JSON_STAT(parser->doc.stats.numbers++);
 
-				expectation = NEXT_ITEM_EXPECTATION;
-			}
-			else
-			{
-				GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
-			}
-			break;
+			parser->expectation = NEXT_ITEM_EXPECTATION;
 		}
+		else
+		{
+			GUARD(false, JSON_ERROR_UNEXPECTED_TOKEN);
 		}
+		break;
+	}
+	}
 
-		if (array_count(stack) > 0)
+	*praw = raw;
+	if (parser->handler != NULL)
+	{
+		/* the root is kept on the stack like json_parse keeps it, only for json_parse_finish to find */
+		GUARD(array_count(stack) > 0 || array_push(stack, (value_t) { .type = next.type }), JSON_ERROR_SYSTEM);
+		EMIT(key ? JSON_EVENT_KEY : JSON_EVENT_VALUE, next);
+		if (next.type == TYPE_STRING)
 		{
-			value_t parent = ARRAY_TOP(stack);
-			if (parent.type == TYPE_OBJECT)
-			{
-				GUARD(hashmap_next_set(parent.data.object, next), JSON_ERROR_SYSTEM);
-				continue;
-			}
-
-			GUARD(array_push(parent.data.array, next), JSON_ERROR_SYSTEM);
-			continue;
+			arena_reset(parser->doc.arena); /* the string was decoded into scratch space */
 		}
-
-		GUARD(array_push(stack, next), JSON_ERROR_SYSTEM);
+		return true;
 	}
 
-	GUARD(indent == 0, JSON_ERROR_MISC);
-	GUARD(array_count(stack) == 1, JSON_ERROR_MISC);
-	doc.head = ARRAY_TOP(stack);
-	if (doc.head.type == TYPE_OBJECT)
+	if (!array_push(array_count(stack) > 0 ? parser->values : stack, next))
 	{
-		GUARD(hashmap_next_key(doc.head.data.object) == NULL, JSON_ERROR_EXPECTED_VALUE);
+		if (next.type == TYPE_STRING && parser->doc.arena == NULL && !parser->in_situ)
+		{
+			allocator_free(parser->doc.allocator, next.data.string, key ? ALLOC_KEY : ALLOC_STRING);
+		}
+		GUARD(false, JSON_ERROR_SYSTEM);
 	}
-	array_destroy(stack);
-
-	return doc;
+	return true;
+#undef EMIT
 #undef GUARD
 }
 
-static void json_destroy_map_iterator(hashmap_t map, void* user, const char* key, value_t val)
+/* checks the document is complete once raw, its end, is reached */
+static bool json_parse_finish(struct json_parser* parser, const char* raw)
 {
-	json_destroy(val);
-	free(key);
+#define GUARD(condition, err) if (!(condition)) { parser->doc.error = err; parser->doc.pos = (int)(parser->offset + (size_t)(raw - parser->begin)); return false; }
+	array_t stack = parser->stack;
+	GUARD(parser->indent == 0, JSON_ERROR_MISC);
+	GUARD(array_count(stack) == 1, JSON_ERROR_MISC);
+	if (parser->handler != NULL)
+	{
+		return true;
+	}
+	parser->doc.head = ARRAY_TOP(stack);
+	return true;
+#undef GUARD
 }
 
-void json_destroy(value_t head)
+static json_state_t json_parse_internal(const char* raw, json_settings_t parse_settings, const allocator_t* allocator)
 {
-	switch (head.type)
+	struct json_parser parser;
+	if (json_parser_init(&parser, raw, parse_settings, 0, allocator))
 	{
-	case TYPE_ARRAY:
-	{
-		for (int i = 0; i < array_count(head.data.array); i++)
+		for (; *raw; raw++)
 		{
-			json_destroy(array_get(head.data.array, i));
+			if (!json_parse_token(&parser, &raw))
+			{
+				return json_parser_release(&parser);
+			}
 		}
-		array_destroy(head.data.array);
-		break;
+		json_parse_finish(&parser, raw);
 	}
-	case TYPE_OBJECT:
+	return json_parser_release(&parser);
+}
+
+/* bytes that can directly follow a number or literal without being a token the byte loop would have seen first */
+static inline bool json_is_atom_end(char ch)
+{
+	switch (ch)
 	{
-		hashmap_iterate(head.data.object, 0, json_destroy_map_iterator);
-		hashmap_destroy(head.data.object);
-		break;
+	case ' ': case '\n': case '\r': case '\t':
+	case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+	case '\0':
+		return true;
+	default:
+		return false;
 	}
-	case TYPE_STRING:
-		free(head.data.string);
-		break;
+}
+
+/*	stage 2 of the indexed engine. Whitespace is never visited: anything else outside of strings is indexed by
+	scan_structurals, so handing just the indexed positions to json_parse_token is equivalent to the byte loop.
+	The one exception is garbage glued to the end of a number or literal, which is handed over separately.
+	The index is built a window at a time so it stays in cache and its size doesn't depend on the document's */
+static json_state_t json_parse_indexed_internal(const char* raw, json_settings_t parse_settings)
+{
+	struct json_parser parser;
+	if (!json_parser_init(&parser, raw, parse_settings, 0, NULL))
+	{
+		return json_parser_release(&parser);
+	}
+
+	uint32_t* positions = malloc(sizeof * positions * SCAN_POSITIONS_SIZE(JSON_INDEX_WINDOW));
+	if (positions == NULL)
+	{
+		parser.doc.error = JSON_ERROR_SYSTEM;
+		return json_parser_release(&parser);
+	}
+
+	size_t length = strlen(raw);
+	const char* consumed = raw;
+	scan_structural_state_t scan = { 0 };
+	for (size_t window = 0; window < length; window += JSON_INDEX_WINDOW)
+	{
+		const char* base = raw + window;
+		size_t count = scan_structurals(&scan, base, length - window < JSON_INDEX_WINDOW ? length - window : JSON_INDEX_WINDOW, positions);
+		for (size_t i = 0; i < count; i++)
+		{
+			const char* token = base + positions[i];
+			if (token < consumed)
+			{
+				continue;
+			}
+
+			char first = *token;
+			if (!json_parse_token(&parser, &token))
+			{
+				free(positions);
+				return json_parser_release(&parser);
+			}
+			consumed = token + 1;
+
+			if (first != '"' && !json_is_atom_end(first) && !json_is_atom_end(*consumed))
+			{
+				token = consumed;
+				if (!json_parse_token(&parser, &token))
+				{
+					free(positions);
+					return json_parser_release(&parser);
+				}
+				consumed = token + 1;
+			}
+		}
 	}
+	free(positions);
+
+	json_parse_finish(&parser, raw + length);
+	return json_parser_release(&parser);
 }
 
-struct print_state
+json_state_t json_parse(const char* raw, json_settings_t settings)
 {
-	FILE* out;
-	int printed_count;
+	return json_parse_internal(raw, settings & ~JSON_IN_SITU, NULL);
+}
+
+json_state_t json_parse_with(const char* raw, json_settings_t settings, const allocator_t* allocator)
+{
+	return json_parse_internal(raw, settings & ~JSON_IN_SITU, allocator);
+}
+
+json_state_t json_parse_in_situ(char* raw, json_settings_t settings)
+{
+	return json_parse_internal(raw, settings | JSON_IN_SITU, NULL);
+}
+
+json_state_t json_parse_indexed(const char* raw, json_settings_t settings)
+{
+	json_settings_t parse_settings = settings & ~JSON_IN_SITU;
+	if (parse_settings & JSON_ALLOW_COMMENTS)
+	{
+		/* comments can hide quotes and brackets from the index */
+		return json_parse_internal(raw, parse_settings, NULL);
+	}
+	return json_parse_indexed_internal(raw, parse_settings);
+}
+
+json_state_t json_parse_events(const char* raw, json_settings_t settings, json_event_handler handler, void* user)
+{
+	/* strings are decoded into an arena that is emptied after each one */
+	struct json_parser parser;
+	if (json_parser_init(&parser, raw, (settings & ~JSON_IN_SITU) | JSON_USE_ARENA, 0, NULL))
+	{
+		parser.handler = handler;
+		parser.user = user;
+		for (; *raw; raw++)
+		{
+			if (!json_parse_token(&parser, &raw))
+			{
+				break;
+			}
+		}
+		if (parser.doc.error == JSON_ERROR_NONE)
+		{
+			json_parse_finish(&parser, raw);
+		}
+	}
+	return json_parser_release_events(&parser);
+}
+
+/* how much of a token has been looked at, so a token cut over many chunks is only looked at once */
+struct json_token_scan
+{
+	size_t length; /* bytes of the token seen so far */
+	char kind, /* first byte of the token */
+		comment, /* second byte when kind is '/' */
+		prev; /* last byte seen inside a block comment */
+	bool escaped; /* inside a string, the last byte seen was an unescaped backslash */
 };
 
-static int indent = 0;
-#define PRINT_WITH_INDENT(frmt, ...) fprintf(out, "\n%*s" frmt, indent * 4, "", __VA_ARGS__)
-static void json_print_map_iterator(hashmap_t map, void* user, const char* key, value_t val)
+/*	looks at the bytes of a token from raw to end, continuing where scan left off. Returns where it stopped looking once
+	it has seen enough that json_parse_token won't read past what was seen, or NULL if it needs more bytes */
+static const char* json_token_end(struct json_token_scan* scan, const char* raw, const char* end)
 {
-	struct print_state* state = (struct print_state*)user;
+	if (raw == end)
+	{
+		return NULL;
+	}
+	if (scan->length == 0)
+	{
+		scan->kind = *raw++;
+		scan->length = 1;
+	}
 
-	FILE* out = state->out;
-	PRINT_WITH_INDENT("\"%s\" : ", key);
-	json_write_value(out, val);
-	state->printed_count++;
-	if (state->printed_count < hashmap_count(map))
+	const char* start = raw;
+	switch (scan->kind)
 	{
-		fprintf(out, ",");
+	case '"':
+		for (;;)
+		{
+			if (scan->escaped)
+			{
+				if (raw == end)
+				{
+					return NULL;
+				}
+				raw++;
+				scan->escaped = false;
+			}
+
+			/* a quote is escaped when an odd number of backslashes comes right before it */
+			const char* quote = memchr(raw, '"', (size_t)(end - raw));
+			const char* stop = quote != NULL ? quote : end,
+				* run = stop;
+			for (; run > raw && run[-1] == '\\'; run--);
+			bool odd = (stop - run) % 2 != 0;
+			if (quote == NULL)
+			{
+				scan->escaped = odd;
+				return NULL;
+			}
+			if (!odd)
+			{
+				return quote + 1;
+			}
+			raw = quote + 1;
+		}
+
+	case 't':
+	case 'f':
+	case 'n':
+		/* the longest literal is 5 bytes, or it ends at the first byte that isn't a letter */
+		for (; raw < end && *raw >= 'a' && *raw <= 'z' && scan->length < 5; raw++, scan->length++);
+		if (scan->length == 5)
+		{
+			return raw;
+		}
+		return raw < end ? raw + 1 : NULL;
+
+	case '/':
+		if (scan->length == 1)
+		{
+			if (raw == end)
+			{
+				return NULL;
+			}
+			scan->comment = *raw++;
+			scan->length = 2;
+		}
+		if (scan->comment == '/')
+		{
+			const char* newline = memchr(raw, '\n', (size_t)(end - raw));
+			return newline != NULL ? newline + 1 : NULL;
+		}
+		if (scan->comment == '*')
+		{
+			for (; raw < end; scan->prev = *raw++)
+			{
+				if (scan->prev == '*' && *raw == '/')
+				{
+					return raw + 1;
+				}
+			}
+			return NULL;
+		}
+		return raw;
+
+	default:
+		if (scan->kind == '-' || (scan->kind >= '0' && scan->kind <= '9'))
+		{
+			/* everything a number can be made of, the parser stops at the first byte that isn't */
+			for (; raw < end && ((*raw >= '0' && *raw <= '9') || *raw == '.' || *raw == 'e' || *raw == 'E' || *raw == '+' || *raw == '-'); raw++);
+			scan->length += (size_t)(raw - start);
+			return raw < end ? raw + 1 : NULL;
+		}
+		return raw;
 	}
 }
 
-static void json_write_escaped(FILE* out, char ch)
+struct json_stream
 {
-	switch (ch)
+	struct json_parser parser;
+	size_t consumed; /* bytes of the document handed to json_parse_token so far, the carry starts there */
+	char* carry; /* a token cut off by the end of a chunk, terminated */
+	size_t carry_length,
+		carry_size;
+	struct json_token_scan scan; /* how much of the carry has been looked at */
+};
+
+/* the carry is allocated from allocator like the rest of the document, only the stream itself comes from malloc */
+static json_stream_t json_stream_create_sized(json_settings_t settings, json_event_handler handler, void* user, size_t arena_block, const allocator_t* allocator)
+{
+	json_stream_t stream = malloc(sizeof * stream);
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	*stream = (struct json_stream){ .carry_size = START_STR_SIZE };
+	stream->carry = allocator_alloc(allocator, stream->carry_size, ALLOC_STRING);
+	json_settings_t parse_settings = settings & ~JSON_IN_SITU;
+	if (stream->carry == NULL || !json_parser_init(&stream->parser, NULL, handler != NULL ? parse_settings | JSON_USE_ARENA : parse_settings, arena_block, allocator))
+	{
+		json_parser_release(&stream->parser);
+		if (stream->carry != NULL)
+		{
+			allocator_free(allocator, stream->carry, ALLOC_STRING);
+		}
+		free(stream);
+		return NULL;
+	}
+	stream->parser.handler = handler;
+	stream->parser.user = user;
+	stream->carry[0] = '\0';
+	return stream;
+}
+
+json_stream_t json_stream_create(json_settings_t settings, json_event_handler handler, void* user)
+{
+	return json_stream_create_sized(settings, handler, user, 0, NULL);
+}
+
+json_stream_t json_stream_create_with(json_settings_t settings, json_event_handler handler, void* user, const allocator_t* allocator)
+{
+	return json_stream_create_sized(settings, handler, user, 0, allocator);
+}
+
+/*	finds how far into [raw, end) tokens can start without being looked at by json_token_end first. A string starting
+	before the last unescaped quote ends there at the latest, a number or literal before the last delimiter ends there */
+static void json_stream_bounds(const char* raw, const char* end, const char** pstring, const char** patom)
+{
+	const char* curr = end;
+	for (; curr > raw && !(json_is_atom_end(curr[-1]) && curr[-1] != '"' && curr[-1] != '\0'); curr--);
+	*patom = curr > raw ? curr - 1 : raw;
+
+	for (curr = end; curr > raw; curr--)
+	{
+		if (curr[-1] == '"')
+		{
+			const char* run = curr - 1;
+			for (; run > raw && run[-1] == '\\'; run--);
+			if ((curr - 1 - run) % 2 == 0)
+			{
+				break;
+			}
+		}
+	}
+	*pstring = curr > raw ? curr - 1 : raw;
+}
+
+/*	hands every complete token from *praw to end to the parser, leaving *praw on the first byte of a token that is cut off.
+	The scan of that token is left in stream->scan */
+static bool json_stream_run(json_stream_t stream, const char** praw, const char* end)
+{
+	struct json_parser* parser = &stream->parser;
+	const char* raw = *praw,
+		* string_bound,
+		* atom_bound;
+	json_stream_bounds(raw, end, &string_bound, &atom_bound);
+	parser->begin = raw;
+	parser->offset = stream->consumed;
+	parser->end = end;
+	while (raw < end)
+	{
+		/* strings, numbers, literals and comments are the only tokens longer than a byte, comments are always checked */
+		if (*raw == '"' ? raw >= string_bound : !json_is_atom_end(*raw) && (raw >= atom_bound || *raw == '/'))
+		{
+			stream->scan = (struct json_token_scan){ 0 };
+			if (json_token_end(&stream->scan, raw, end) == NULL)
+			{
+				break;
+			}
+		}
+		if (!json_parse_token(parser, &raw))
+		{
+			return false;
+		}
+		raw++;
+	}
+	stream->consumed += (size_t)(raw - *praw);
+	*praw = raw;
+	return true;
+}
+
+static bool json_stream_carry(json_stream_t stream, const char* raw, size_t length)
+{
+	if (stream->carry_length + length + 1 > stream->carry_size)
+	{
+		size_t new_size = stream->carry_size * 2 > stream->carry_length + length + 1 ? stream->carry_size * 2 : stream->carry_length + length + 1;
+		char* new = allocator_realloc(stream->parser.doc.allocator, stream->carry, stream->carry_size, new_size, ALLOC_STRING);
+		if (new == NULL)
+		{
+			stream->parser.doc.error = JSON_ERROR_SYSTEM;
+			return false;
+		}
+		stream->carry = new;
+		stream->carry_size = new_size;
+	}
+	memcpy(stream->carry + stream->carry_length, raw, length);
+	stream->carry_length += length;
+	stream->carry[stream->carry_length] = '\0';
+	return true;
+}
+
+json_error_t json_stream_feed(json_stream_t stream, const char* chunk, size_t length)
+{
+	const char* end = chunk + length;
+	while (stream->parser.doc.error == JSON_ERROR_NONE && chunk < end)
+	{
+		if (stream->carry_length == 0)
+		{
+			if (json_stream_run(stream, &chunk, end))
+			{
+				json_stream_carry(stream, chunk, (size_t)(end - chunk));
+			}
+			break;
+		}
+
+		/* finish the carried token with the start of the chunk, then parse it and whatever came with it from the carry */
+		const char* stop = json_token_end(&stream->scan, chunk, end);
+		const char* taken = stop != NULL ? stop : end;
+		if (!json_stream_carry(stream, chunk, (size_t)(taken - chunk)) || stop == NULL)
+		{
+			break;
+		}
+		chunk = taken;
+
+		const char* raw = stream->carry;
+		if (json_stream_run(stream, &raw, stream->carry + stream->carry_length))
+		{
+			stream->carry_length -= (size_t)(raw - stream->carry);
+			memmove(stream->carry, raw, stream->carry_length + 1);
+		}
+	}
+	return stream->parser.doc.error;
+}
+
+json_state_t json_stream_finish(json_stream_t stream)
+{
+	struct json_parser* parser = &stream->parser;
+	if (parser->doc.error == JSON_ERROR_NONE)
+	{
+		/* the carry is what was cut off by the end of the document, which json_parse_token handles like json_parse does */
+		const char* raw = stream->carry,
+			* end = stream->carry + stream->carry_length;
+		parser->begin = raw;
+		parser->offset = stream->consumed;
+		parser->end = end;
+		for (; raw < end; raw++)
+		{
+			if (!json_parse_token(parser, &raw))
+			{
+				break;
+			}
+		}
+		if (parser->doc.error == JSON_ERROR_NONE)
+		{
+			json_parse_finish(parser, raw);
+		}
+	}
+
+	json_state_t doc = parser->handler != NULL ? json_parser_release_events(parser) : json_parser_release(parser);
+	allocator_free(doc.allocator, stream->carry, ALLOC_STRING);
+	free(stream);
+	return doc;
+}
+
+json_state_t json_parse_n(const char* raw, size_t length, json_settings_t settings)
+{
+	return json_parse_n_with(raw, length, settings, NULL);
+}
+
+json_state_t json_parse_n_with(const char* raw, size_t length, json_settings_t settings, const allocator_t* allocator)
+{
+	/*	a stream only hands the parser tokens that end inside its buffer, and copies the one cut off by the end.
+		Small documents, like lines of json_parse_lines, get arena blocks sized after them instead of the default */
+	json_stream_t stream = json_stream_create_sized(settings, NULL, NULL, length < JSON_SMALL_DOCUMENT ? JSON_SMALL_ARENA_BLOCK : 0, allocator);
+	if (stream == NULL)
+	{
+		return (json_state_t){ .head = { .type = TYPE_NULL }, .error = JSON_ERROR_SYSTEM };
+	}
+	json_stream_feed(stream, raw, length);
+	return json_stream_finish(stream);
+}
+
+/* a run of whole lines parsed by one worker */
+struct json_lines_chunk
+{
+	const char* begin,
+		* end;
+	json_state_t* docs;
+	size_t count;
+	bool done,
+		failed; /* ran out of memory before every line was parsed */
+};
+
+struct json_lines
+{
+	struct json_lines_chunk* chunks;
+	size_t chunk_count,
+		next, /* first chunk no worker has taken */
+		delivered; /* first chunk not handed to the handler */
+	size_t window;
+	json_settings_t settings;
+	bool stop;
+	mtx_t lock;
+	cnd_t changed;
+};
+
+/* parses every line of chunk into its own document */
+static void json_lines_parse_chunk(struct json_lines_chunk* chunk, json_settings_t settings)
+{
+	size_t reserved = 0;
+	for (const char* line = chunk->begin; line < chunk->end;)
+	{
+		const char* newline = memchr(line, '\n', (size_t)(chunk->end - line));
+		const char* line_end = newline != NULL ? newline : chunk->end;
+		if (chunk->count == reserved)
+		{
+			size_t new_reserved = reserved > 0 ? reserved * 2 : 64;
+			json_state_t* new = realloc(chunk->docs, sizeof * new * new_reserved);
+			if (new == NULL)
+			{
+				chunk->failed = true;
+				return;
+			}
+			chunk->docs = new;
+			reserved = new_reserved;
+		}
+		chunk->docs[chunk->count++] = json_parse_n(line, (size_t)(line_end - line), settings);
+		line = line_end + 1;
+	}
+}
+
+static int json_lines_work(void* user)
+{
+	struct json_lines* lines = user;
+	for (;;)
+	{
+		mtx_lock(&lines->lock);
+		while (!lines->stop && lines->next < lines->chunk_count && lines->next >= lines->delivered + lines->window)
+		{
+			cnd_wait(&lines->changed, &lines->lock);
+		}
+		if (lines->stop || lines->next >= lines->chunk_count)
+		{
+			mtx_unlock(&lines->lock);
+			return 0;
+		}
+		struct json_lines_chunk* chunk = &lines->chunks[lines->next++];
+		mtx_unlock(&lines->lock);
+
+		json_lines_parse_chunk(chunk, lines->settings);
+
+		mtx_lock(&lines->lock);
+		chunk->done = true;
+		cnd_broadcast(&lines->changed);
+		mtx_unlock(&lines->lock);
+	}
+}
+
+bool json_parse_lines(const char* raw, size_t length, json_settings_t settings, int threads, json_line_handler handler, void* user)
+{
+	struct json_lines lines = { .settings = settings, .window = (size_t)(threads > 0 ? threads : pool_cores()) * JSON_LINES_WINDOW };
+
+	/* chunks end right after a newline, a trailing newline doesn't start another line */
+	const char* end = raw + length;
+	size_t reserved = length / JSON_LINES_CHUNK + 1;
+	lines.chunks = malloc(sizeof * lines.chunks * reserved);
+	if (lines.chunks == NULL)
+	{
+		return false;
+	}
+	for (const char* begin = raw; begin < end;)
+	{
+		const char* chunk_end = end;
+		if ((size_t)(end - begin) > JSON_LINES_CHUNK)
+		{
+			const char* newline = memchr(begin + JSON_LINES_CHUNK, '\n', (size_t)(end - begin - JSON_LINES_CHUNK));
+			chunk_end = newline != NULL ? newline + 1 : end;
+		}
+		lines.chunks[lines.chunk_count++] = (struct json_lines_chunk){ .begin = begin, .end = chunk_end };
+		begin = chunk_end;
+	}
+
+	if (mtx_init(&lines.lock, mtx_plain) != thrd_success)
+	{
+		free(lines.chunks);
+		return false;
+	}
+	if (cnd_init(&lines.changed) != thrd_success)
+	{
+		mtx_destroy(&lines.lock);
+		free(lines.chunks);
+		return false;
+	}
+
+	pool_t pool = pool_start(threads, json_lines_work, &lines);
+	bool result = pool != NULL;
+	size_t line = 0;
+	for (size_t i = 0; result && i < lines.chunk_count; i++)
+	{
+		struct json_lines_chunk* chunk = &lines.chunks[i];
+		mtx_lock(&lines.lock);
+		while (!chunk->done)
+		{
+			cnd_wait(&lines.changed, &lines.lock);
+		}
+		mtx_unlock(&lines.lock);
+
+		result = !chunk->failed;
+		size_t j = 0;
+		for (; result && j < chunk->count; j++)
+		{
+			result = handler(user, line++, chunk->docs[j]);
+		}
+		for (; j < chunk->count; j++)
+		{
+			json_destroy_state(&chunk->docs[j]);
+		}
+		free(chunk->docs);
+		chunk->docs = NULL;
+
+		mtx_lock(&lines.lock);
+		lines.delivered = i + 1;
+		lines.stop = !result;
+		cnd_broadcast(&lines.changed);
+		mtx_unlock(&lines.lock);
+	}
+
+	if (pool != NULL)
+	{
+		pool_join(pool);
+	}
+	/* what the workers finished after the handler stopped */
+	for (size_t i = lines.delivered; i < lines.chunk_count; i++)
+	{
+		for (size_t j = 0; j < lines.chunks[i].count; j++)
+		{
+			json_destroy_state(&lines.chunks[i].docs[j]);
+		}
+		free(lines.chunks[i].docs);
+	}
+	cnd_destroy(&lines.changed);
+	mtx_destroy(&lines.lock);
+	free(lines.chunks);
+	return result;
+}
+
+struct json_lines_all
+{
+	json_state_t* docs;
+	size_t count,
+		reserved;
+};
+
+static bool json_lines_collect(void* user, size_t line, json_state_t doc)
+{
+	struct json_lines_all* all = user;
+	if (all->count == all->reserved)
 	{
-	case '\b':
-		fprintf(out, "\\b");
+		size_t new_reserved = all->reserved > 0 ? all->reserved * 2 : 64;
+		json_state_t* new = realloc(all->docs, sizeof * new * new_reserved);
+		if (new == NULL)
+		{
+			json_destroy_state(&doc);
+			return false;
+		}
+		all->docs = new;
+		all->reserved = new_reserved;
+	}
+	all->docs[all->count++] = doc;
+	return true;
+}
+
+json_state_t* json_parse_lines_all(const char* raw, size_t length, json_settings_t settings, int threads, size_t* count)
+{
+	struct json_lines_all all = { 0 };
+	if (!json_parse_lines(raw, length, settings, threads, json_lines_collect, &all))
+	{
+		for (size_t i = 0; i < all.count; i++)
+		{
+			json_destroy_state(&all.docs[i]);
+		}
+		free(all.docs);
+		*count = 0;
+		return NULL;
+	}
+	*count = all.count;
+	return all.docs;
+}
+
+static void json_destroy_map_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	const struct json_destroy_strings* strings = user;
+	json_destroy_value(val, strings);
+	if (strings->owned)
+	{
+		allocator_free(strings->allocator, (char*)key, ALLOC_KEY);
+	}
+}
+
+static void json_destroy_value(value_t head, const struct json_destroy_strings* strings)
+{
+	switch (head.type)
+	{
+	case TYPE_ARRAY:
+	{
+		for (int i = 0; i < array_count(head.data.array); i++)
+		{
+			json_destroy_value(array_get(head.data.array, i), strings);
+		}
+		array_destroy(head.data.array);
 		break;
-	case '\f':
-		fprintf(out, "\\f");
+	}
+	case TYPE_OBJECT:
+	{
+		hashmap_iterate(head.data.object, (void*)strings, json_destroy_map_iterator);
+		hashmap_destroy(head.data.object);
 		break;
-	case '\n':
-		fprintf(out, "\\n");
+	}
+	case TYPE_STRING:
+		if (strings->owned)
+		{
+			allocator_free(strings->allocator, head.data.string, ALLOC_STRING);
+		}
 		break;
-	case '\r':
-		fprintf(out, "\\r");
+	default:
 		break;
-	case '\t':
-		fprintf(out, "\\t");
+	}
+}
+
+#ifdef JSON_STATS
+static void json_memory_usage_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	*(size_t*)user += strlen(key) + 1 + json_memory_usage(val);
+}
+
+size_t json_memory_usage(value_t val)
+{
+	size_t total = 0;
+	switch (val.type)
+	{
+	case TYPE_ARRAY:
+		total = array_memory_usage(val.data.array);
+		for (int i = 0; i < array_count(val.data.array); i++)
+		{
+			total += json_memory_usage(array_get(val.data.array, i));
+		}
+		break;
+	case TYPE_OBJECT:
+		total = hashmap_memory_usage(val.data.object);
+		hashmap_iterate(val.data.object, &total, json_memory_usage_iterator);
+		break;
+	case TYPE_STRING:
+		total = strlen(val.data.string) + 1;
 		break;
 	default:
+		break;
+	}
+	return total;
+}
+#endif
+
+void json_destroy(value_t head)
+{
+	json_destroy_value(head, &(struct json_destroy_strings){ .owned = true });
+}
+
+void json_destroy_state(json_state_t* doc)
+{
+	if (doc->arena != NULL)
+	{
+		arena_destroy(doc->arena);
+		doc->arena = NULL;
+	}
+	else if (doc->error == JSON_ERROR_NONE)
+	{
+		json_destroy_value(doc->head, &(struct json_destroy_strings){ .owned = !(doc->settings & JSON_IN_SITU), .allocator = doc->allocator });
+	}
+	doc->head = (value_t){ .type = TYPE_NULL };
+}
+
+#define JSON_WRITER_BUFFER (64 << 10)
+
+struct json_writer
+{
+	char* data;
+	size_t length,
+		reserved;
+	FILE* out;
+	bool failed;
+	int indent, /* spaces per level, JSON_WRITER_COMPACT for none */
+		depth;
+};
+
+json_writer_t json_writer_create(FILE* out, int indent)
+{
+	json_writer_t writer = malloc(sizeof * writer);
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+	*writer = (struct json_writer){ .data = malloc(JSON_WRITER_BUFFER), .reserved = JSON_WRITER_BUFFER, .out = out, .indent = indent > 0 ? indent : JSON_WRITER_COMPACT };
+	if (writer->data == NULL)
+	{
+		free(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+void json_writer_destroy(json_writer_t writer)
+{
+	json_writer_flush(writer);
+	free(writer->data);
+	free(writer);
+}
+
+bool json_writer_flush(json_writer_t writer)
+{
+	if (writer->out != NULL && writer->length > 0)
 	{
-		if (isprint(ch))
+		writer->failed |= fwrite(writer->data, 1, writer->length, writer->out) != writer->length;
+		writer->length = 0;
+	}
+	return !writer->failed;
+}
+
+const char* json_writer_data(const json_writer_t writer, size_t* length)
+{
+	*length = writer->length;
+	return writer->data;
+}
+
+/* room for size more bytes, flushing to the file or growing the buffer. NULL once the writer has failed */
+static inline char* json_writer_reserve(json_writer_t writer, size_t size)
+{
+	if (writer->length + size > writer->reserved)
+	{
+		if (writer->out != NULL)
+		{
+			json_writer_flush(writer);
+		}
+		if (writer->length + size > writer->reserved)
 		{
-			fputc(ch, out);
+			size_t new_reserved = writer->reserved * 2;
+			for (; writer->length + size > new_reserved; new_reserved *= 2);
+			char* new = realloc(writer->data, new_reserved);
+			if (new == NULL)
+			{
+				writer->failed = true;
+			}
+			else
+			{
+				writer->data = new;
+				writer->reserved = new_reserved;
+			}
+		}
+	}
+	return writer->failed ? NULL : writer->data + writer->length;
+}
+
+static inline void json_writer_put(json_writer_t writer, const char* bytes, size_t size)
+{
+	char* dest = json_writer_reserve(writer, size);
+	if (dest != NULL)
+	{
+		memcpy(dest, bytes, size);
+		writer->length += size;
+	}
+}
+
+#define JSON_WRITER_LITERAL(writer, literal) json_writer_put((writer), (literal), sizeof(literal) - 1)
+
+/* a line break and the current indentation, nothing in compact mode */
+static inline void json_writer_newline(json_writer_t writer)
+{
+	if (writer->indent == JSON_WRITER_COMPACT)
+	{
+		return;
+	}
+	size_t size = 1 + (size_t)writer->depth * (size_t)writer->indent;
+	char* dest = json_writer_reserve(writer, size);
+	if (dest != NULL)
+	{
+		dest[0] = '\n';
+		memset(dest + 1, ' ', size - 1);
+		writer->length += size;
+	}
+}
+
+/*	what each byte is written as inside a string: 0 for itself, a letter for a two byte escape, 'u' for \u00XX.
+	Bytes past 0x7F are parts of utf-8 sequences and written as they are */
+static const char json_escapes[256] =
+{
+	['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't', ['"'] = '"', ['\\'] = '\\',
+	[0x00] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u', [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+	[0x0B] = 'u', [0x0E] = 'u', [0x0F] = 'u', [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u', [0x14] = 'u',
+	[0x15] = 'u', [0x16] = 'u', [0x17] = 'u', [0x18] = 'u', [0x19] = 'u', [0x1A] = 'u', [0x1B] = 'u', [0x1C] = 'u',
+	[0x1D] = 'u', [0x1E] = 'u', [0x1F] = 'u'
+};
+
+/* writes str quoted, copying the runs between escapes in one go */
+static void json_writer_string(json_writer_t writer, const char* str)
+{
+	JSON_WRITER_LITERAL(writer, "\"");
+	for (;;)
+	{
+		const char* run = str;
+		for (; *str && !json_escapes[(unsigned char)*str]; str++);
+		json_writer_put(writer, run, (size_t)(str - run));
+		if (!*str)
+		{
+			break;
+		}
+
+		char escape = json_escapes[(unsigned char)*str];
+		if (escape == 'u')
+		{
+			static const char hex[] = "0123456789abcdef";
+			char sequence[6] = { '\\', 'u', '0', '0', hex[(unsigned char)*str >> 4], hex[*str & 0xF] };
+			json_writer_put(writer, sequence, sizeof sequence);
 		}
 		else
 		{
-			fprintf(out, "\\X%02hhX", ch); /* leading 0s, signed char input in uppercase hex */
+			char sequence[2] = { '\\', escape };
+			json_writer_put(writer, sequence, sizeof sequence);
 		}
+		str++;
 	}
+	JSON_WRITER_LITERAL(writer, "\"");
+}
+
+struct json_writer_members
+{
+	json_writer_t writer;
+	int written;
+};
+
+static void json_writer_member(hashmap_t map, void* user, const char* key, value_t val)
+{
+	struct json_writer_members* members = user;
+	json_writer_t writer = members->writer;
+	if (members->written++ > 0)
+	{
+		JSON_WRITER_LITERAL(writer, ",");
+	}
+	json_writer_newline(writer);
+	json_writer_string(writer, key);
+	if (writer->indent == JSON_WRITER_COMPACT)
+	{
+		JSON_WRITER_LITERAL(writer, ":");
 	}
+	else
+	{
+		JSON_WRITER_LITERAL(writer, " : ");
+	}
+	json_writer_value(writer, val);
 }
 
-void json_write_value(FILE* out, value_t val)
+bool json_writer_value(json_writer_t writer, value_t val)
 {
 	switch (val.type)
 	{
 	case TYPE_ARRAY:
 	{
-		fprintf(out, "[");
-		indent++;
-		for (int i = 0; i < array_count(val.data.array); i++)
+		int count = array_count(val.data.array);
+		JSON_WRITER_LITERAL(writer, "[");
+		writer->depth++;
+		for (int i = 0; i < count; i++)
 		{
-			PRINT_WITH_INDENT("%s", ""); /* needs an argument in __VA_ARGS__ otherwise there's a syntax error */
-			json_write_value(out, array_get(val.data.array, i));
-			if (i + 1 < array_count(val.data.array))
+			if (i > 0)
 			{
-				fprintf(out, ",");
+				JSON_WRITER_LITERAL(writer, ",");
 			}
+			json_writer_newline(writer);
+			json_writer_value(writer, array_get(val.data.array, i));
 		}
-		indent--;
-		if (array_count(val.data.array) > 0)
+		writer->depth--;
+		if (count > 0)
 		{
-			PRINT_WITH_INDENT("%s", "");
+			json_writer_newline(writer);
 		}
-		fprintf(out, "]");
+		JSON_WRITER_LITERAL(writer, "]");
 		break;
 	}
 	case TYPE_OBJECT:
 	{
-		fprintf(out, "{");
-		indent++;
-		struct print_state this = { .out = out };
-		hashmap_iterate(val.data.object, &this, json_print_map_iterator);
-		indent--;
-		PRINT_WITH_INDENT("%s}", "");
+		struct json_writer_members members = { .writer = writer };
+		JSON_WRITER_LITERAL(writer, "{");
+		writer->depth++;
+		hashmap_iterate(val.data.object, &members, json_writer_member);
+		writer->depth--;
+		json_writer_newline(writer);
+		JSON_WRITER_LITERAL(writer, "}");
 		break;
 	}
 	case TYPE_STRING:
+		json_writer_string(writer, val.data.string);
+		break;
+	case TYPE_NUMBER:
 	{
-		fprintf(out, "\"");
-		for (char* curr = val.data.string; *curr; curr++)
+		if (!isfinite(val.data.number))
 		{
-			json_write_escaped(out, *curr);
+			JSON_WRITER_LITERAL(writer, "null"); /* json has no infinities or nans */
+			break;
 		}
-		fprintf(out, "\"");
+		char digits[NUMBER_DOUBLE_SIZE];
+		json_writer_put(writer, digits, number_write_double(val.data.number, digits));
 		break;
 	}
-	case TYPE_NUMBER:
-		fprintf(out, "%f", val.data.number);
+	case TYPE_INTEGER:
+	{
+		char digits[NUMBER_INTEGER_SIZE];
+		json_writer_put(writer, digits, number_write_integer(val.data.integer, digits));
 		break;
+	}
+	case TYPE_UINTEGER:
+	{
+		char digits[NUMBER_INTEGER_SIZE];
+		json_writer_put(writer, digits, number_write_unsigned(val.data.uinteger, digits));
+		break;
+	}
 	case TYPE_BOOLEAN:
-		fprintf(out, "%s", val.data.boolean ? "true" : "false");
+		if (val.data.boolean)
+		{
+			JSON_WRITER_LITERAL(writer, "true");
+		}
+		else
+		{
+			JSON_WRITER_LITERAL(writer, "false");
+		}
 		break;
 	case TYPE_NULL:
-		fprintf(out, "null");
+		JSON_WRITER_LITERAL(writer, "null");
 		break;
 	}
+	return !writer->failed;
 }
-#undef PRINT_WITH_INDENT
\ No newline at end of file
+
+bool json_write_value(FILE* out, value_t val)
+{
+	json_writer_t writer = json_writer_create(out, 4);
+	if (writer == NULL)
+	{
+		return false;
+	}
+	bool written = json_writer_value(writer, val) && json_writer_flush(writer);
+	json_writer_destroy(writer);
+	return written;
+}
\ No newline at end of file
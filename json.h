@@ -20,6 +20,7 @@ typedef enum json_error
 	JSON_ERROR_EXPECTED_VALUE,
 	JSON_ERROR_NULL_TERMINATOR,
 	JSON_ERROR_MISC,
+	JSON_ERROR_ABORTED, /* an event handler returned false */
 	JSON_ERROR_COUNT,
 } json_error_t;
 
@@ -27,26 +28,150 @@ typedef enum json_settings
 {
 	JSON_ALLOW_COMMENTS = 0x01,
 	JSON_CHECK_BOM = 0x02,
+	JSON_USE_ARENA = 0x04, /* every node, key and string of the document is allocated from one arena owned by the state */
+	JSON_IN_SITU = 0x08, /* set on states returned by json_parse_in_situ, strings and keys point into the parsed buffer */
+	/*	numbers without a fraction or exponent that fit in an int64_t become TYPE_INTEGER, and those past it that fit in a
+		uint64_t TYPE_UINTEGER */
+	JSON_PARSE_INTEGERS = 0x10,
+	/*	equal keys of a document share one copy, hashed once when first seen, instead of one copy each.
+		Only used with JSON_USE_ARENA, as keys freed one by one can't be shared */
+	JSON_INTERN_KEYS = 0x20,
+	JSON_INTERN_STRINGS = 0x40, /* same as JSON_INTERN_KEYS for string values no longer than JSON_INTERN_STRING_LENGTH */
 } json_settings_t;
 
+#define JSON_INTERN_STRING_LENGTH 16
+
+#ifdef JSON_STATS
+/*	what parsing a document met, to explain what it costs. Only exists when built with JSON_STATS, which adds nothing
+	to parsing otherwise. Counts cover everything parsed before an error too */
+typedef struct json_stats
+{
+	size_t objects,
+		arrays,
+		strings, /* string values, keys are counted on their own */
+		keys,
+		numbers, /* TYPE_NUMBER, TYPE_INTEGER and TYPE_UINTEGER */
+		literals, /* true, false and null */
+		string_bytes; /* decoded bytes of every string and key, without terminators */
+	int max_depth; /* most containers open at once */
+	int hashmap_resizes; /* times the document's objects grew their storage while being built */
+	size_t probes; /* pairs or slots looked at to find every key of every object once, see hashmap_stats */
+	int longest_probe;
+	size_t bytes; /* held by the finished document: its arena, or json_memory_usage of its head */
+} json_stats_t;
+#endif
+
 typedef struct json_state
 {
 	value_t head;
 	json_error_t error;
 	int pos;
 	json_settings_t settings;
+	arena_t arena; /* NULL unless parsed with JSON_USE_ARENA */
+	const allocator_t* allocator; /* where the document was allocated from, NULL for malloc */
+#ifdef JSON_STATS
+	json_stats_t stats;
+#endif
 } json_state_t;
 
-/*	settings are saved in a global variable instead of being passed once 
-	because its likely the same settings will be used multiple times. */
+typedef enum json_event
+{
+	JSON_EVENT_START_OBJECT,
+	JSON_EVENT_END_OBJECT,
+	JSON_EVENT_START_ARRAY,
+	JSON_EVENT_END_ARRAY,
+	JSON_EVENT_KEY, /* val is the key, as a TYPE_STRING */
+	JSON_EVENT_VALUE, /* val is a string, number, integer, boolean or null */
+} json_event_t;
+
+typedef struct json_stream* json_stream_t;
+
+/*	called by json_parse_events for each event of a document, in order. Strings in val only live until it returns.
+	Returning false stops parsing with JSON_ERROR_ABORTED */
+typedef bool (*json_event_handler)(void* user, json_event_t event, value_t val);
 
-/* parser's settings bitmask */
-extern json_settings_t settings;
+/*	settings are passed to every parse instead of being read from a global, so parses on different threads share nothing
+	and can each use their own. JSON_IN_SITU is ignored, it only depends on the function called */
 
-/*	parses raw given settings defined before call and returns value with any possible error/parser information.
-	settings are saved at the beginning of the function to permit other threads to change settings */
-json_state_t json_parse(const char* raw);
-/* frees value opened by json_parse */
+/* settings for strict json, every node allocated on its own */
+#define JSON_DEFAULT_SETTINGS JSON_CHECK_BOM
+
+/* parses raw given settings and returns value with any possible error/parser information */
+json_state_t json_parse(const char* raw, json_settings_t settings);
+/*	same as json_parse, but every node, string and key, the parser's working memory and any arena come from allocator
+	instead of malloc. allocator must outlive the document, which json_destroy_state gives back to it.
+	json_parse_n_with and json_stream_create_with take one the same way; json_parse_in_situ, json_parse_indexed,
+	json_parse_events, json_parse_lines, tape_parse and lazy_open always allocate from malloc */
+json_state_t json_parse_with(const char* raw, json_settings_t settings, const allocator_t* allocator);
+/*	same as json_parse, but the document is the length bytes at raw instead of ending at the first terminator.
+	raw needs no terminator, parsing stops at raw + length. A terminator before that is an error instead of the end */
+json_state_t json_parse_n(const char* raw, size_t length, json_settings_t settings);
+/* json_parse_n, allocating from allocator like json_parse_with */
+json_state_t json_parse_n_with(const char* raw, size_t length, json_settings_t settings, const allocator_t* allocator);
+/*	same as json_parse, but strings are decoded in place inside raw instead of being copied out of it.
+	raw is modified and must outlive the document; its strings and keys are not freed by json_destroy_state */
+json_state_t json_parse_in_situ(char* raw, json_settings_t settings);
+/*	same as json_parse, but in two stages: structural characters are first indexed with vector instructions, then the tree
+	is built by visiting only those positions instead of every byte. Produces the same trees and errors as json_parse.
+	Documents are handed to json_parse when comments are allowed, since comments can hide structure from the index */
+json_state_t json_parse_indexed(const char* raw, json_settings_t settings);
+/*	same validation and errors as json_parse, but the document is handed to handler as events instead of being built.
+	No nodes are allocated, memory used only depends on how deep the document nests and its longest string.
+	The returned state's head is always null */
+json_state_t json_parse_events(const char* raw, json_settings_t settings, json_event_handler handler, void* user);
+/*	creates a parser that is handed its document a chunk at a time by json_stream_feed, parsing with settings.
+	With a NULL handler the document is built like json_parse builds it, otherwise it is reported to handler like
+	json_parse_events does. Returns NULL on failure */
+json_stream_t json_stream_create(json_settings_t settings, json_event_handler handler, void* user);
+/*	json_stream_create, allocating the document and the stream's buffers from allocator like json_parse_with.
+	The document json_stream_finish returns is freed with json_destroy_state */
+json_stream_t json_stream_create_with(json_settings_t settings, json_event_handler handler, void* user, const allocator_t* allocator);
+/*	parses the next length bytes of the document. Chunks can be cut anywhere, a token cut in two is carried over to the
+	next call. Returns the first error met, after which anything fed is ignored */
+json_error_t json_stream_feed(json_stream_t stream, const char* chunk, size_t length);
+/*	marks the end of the document and frees stream, returning the document with the same trees and errors as json_parse */
+json_state_t json_stream_finish(json_stream_t stream);
+/* called by json_parse_lines with the document of each line, in order. It now owns doc. Returning false stops parsing */
+typedef bool (*json_line_handler)(void* user, size_t line, json_state_t doc);
+
+/*	parses raw as newline delimited json, each line a document parsed like json_parse_n, on threads threads (0 for one
+	per core). Lines are parsed in chunks of about a megabyte, and handler is called from the calling thread for each line
+	in order as soon as its chunk is done. A newline at the very end doesn't start another line.
+	Returns false if handler stopped it or memory or threads ran out */
+bool json_parse_lines(const char* raw, size_t length, json_settings_t settings, int threads, json_line_handler handler, void* user);
+/*	same as json_parse_lines, collecting the documents into an array of *count states, NULL on failure.
+	Each state is freed with json_destroy_state, then the array with free */
+json_state_t* json_parse_lines_all(const char* raw, size_t length, json_settings_t settings, int threads, size_t* count);
+/*	frees value opened by json_parse. Must not be used on values of a document parsed with JSON_USE_ARENA, and strings
+	are given back to malloc, so documents from json_parse_with are freed with json_destroy_state */
 void json_destroy(value_t head);
-/* writes value to out */
-void json_write_value(FILE* out, value_t val);
\ No newline at end of file
+/* frees the document opened by json_parse, whichever way it was allocated. Arena documents are freed a block at a time */
+void json_destroy_state(json_state_t* doc);
+#ifdef JSON_STATS
+/*	bytes held by val and everything under it: containers with their reserved storage, and keys and strings at their
+	length plus terminator. Every value is counted as if it was allocated on its own, which overstates documents
+	parsed in situ or with interned strings */
+size_t json_memory_usage(value_t val);
+#endif
+/*	writes value to out, pretty printed with 4 space indents. Returns false if it ran out of memory or failed to write
+	to out, which may then hold part of value */
+bool json_write_value(FILE* out, value_t val);
+
+typedef struct json_writer* json_writer_t;
+
+/* indent of json_writer_create that leaves out all whitespace */
+#define JSON_WRITER_COMPACT 0
+
+/*	creates a serializer writing into a growable buffer. When out isn't NULL the buffer is written to it whenever it
+	fills, on json_writer_flush and on json_writer_destroy, otherwise it keeps everything written.
+	Pretty prints with indent spaces per level of nesting, or nothing at all with JSON_WRITER_COMPACT.
+	Everything it needs lives in the writer, so any number of writers can be used at once. Returns NULL on failure */
+json_writer_t json_writer_create(FILE* out, int indent);
+/* flushes, then frees writer and its buffer */
+void json_writer_destroy(json_writer_t writer);
+/* appends val. Returns false once the writer failed to grow its buffer or write to its file */
+bool json_writer_value(json_writer_t writer, value_t val);
+/* writes the buffer out to the writer's file, if it has one. Returns false once the writer failed */
+bool json_writer_flush(json_writer_t writer);
+/* what has been written and not flushed, *length bytes of it. Not terminated. Valid until the writer is next used */
+const char* json_writer_data(const json_writer_t writer, size_t* length);
\ No newline at end of file
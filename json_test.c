@@ -1,13 +1,478 @@
-#if 0
+#ifdef JSON_TEST
 #include "json.h"
+#include "number.h"
+#include "path.h"
+#include "pool.h"
 #include <assert.h>
+#include "lazy.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+#include "tape.h"
+#include <threads.h>
+
+static bool test_equal(value_t a, value_t b);
+
+static void test_equal_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	hashmap_t other = *(hashmap_t*)user;
+	assert(hashmap_exists(other, key));
+	assert(test_equal(val, hashmap_get(other, key)));
+}
+
+static bool test_equal(value_t a, value_t b)
+{
+	if (a.type != b.type)
+	{
+		return false;
+	}
+	switch (a.type)
+	{
+	case TYPE_STRING:
+		return strcmp(a.data.string, b.data.string) == 0;
+	case TYPE_NUMBER:
+		return memcmp(&a.data.number, &b.data.number, sizeof a.data.number) == 0;
+	case TYPE_INTEGER:
+		return a.data.integer == b.data.integer;
+	case TYPE_UINTEGER:
+		return a.data.uinteger == b.data.uinteger;
+	case TYPE_BOOLEAN:
+		return a.data.boolean == b.data.boolean;
+	case TYPE_NULL:
+		return true;
+	case TYPE_ARRAY:
+		if (array_count(a.data.array) != array_count(b.data.array))
+		{
+			return false;
+		}
+		for (int i = 0; i < array_count(a.data.array); i++)
+		{
+			if (!test_equal(array_get(a.data.array, i), array_get(b.data.array, i)))
+			{
+				return false;
+			}
+		}
+		return true;
+	case TYPE_OBJECT:
+		if (hashmap_count(a.data.object) != hashmap_count(b.data.object))
+		{
+			return false;
+		}
+		hashmap_iterate(a.data.object, &b.data.object, test_equal_iterator);
+		return true;
+	}
+	return false;
+}
+
+static char* test_copy_string(const char* str)
+{
+	size_t size = strlen(str) + 1;
+	char* copy = malloc(size);
+	assert(copy);
+	return memcpy(copy, str, size);
+}
+
+/* array of count records with escaped strings, fractions and more keys than an inline object holds */
+static char* test_records(int count)
+{
+	char* raw = malloc((size_t)count * 256 + 3);
+	assert(raw);
+	char* curr = raw;
+	*curr++ = '[';
+	for (int i = 0; i < count; i++)
+	{
+		curr += sprintf(curr, "{\"id\":%d,\"name\":\"rec\\\"%d\\\\\\t\",\"x\":%.9g,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,"
+			"\"k5\":5,\"k6\":6,\"k7\":[%d,{\"n\":null}]}%s", i, i, i / 7.0, -i, i + 1 < count ? "," : "");
+	}
+	*curr++ = ']';
+	*curr = '\0';
+	return raw;
+}
+
+/* rebuilds the tree json_parse_events reports */
+struct test_builder
+{
+	value_t root,
+		stack[256];
+	char* keys[256];
+	int depth,
+		events,
+		abort_after; /* aborts at this event when positive */
+};
+
+static void test_builder_add(struct test_builder* builder, value_t val)
+{
+	if (builder->depth == 0)
+	{
+		builder->root = val;
+		return;
+	}
+
+	value_t parent = builder->stack[builder->depth - 1];
+	if (parent.type == TYPE_OBJECT)
+	{
+		char* key = builder->keys[builder->depth - 1];
+		assert(key != NULL);
+		if (hashmap_exists(parent.data.object, key))
+		{
+			/* like the parser, the first copy of a repeated key is kept with the last value */
+			json_destroy(hashmap_get(parent.data.object, key));
+			assert(hashmap_set(parent.data.object, key, val));
+			free(key);
+		}
+		else
+		{
+			assert(hashmap_set(parent.data.object, key, val));
+		}
+		builder->keys[builder->depth - 1] = NULL;
+	}
+	else
+	{
+		assert(array_push(parent.data.array, val));
+	}
+}
+
+static bool test_builder_handler(void* user, json_event_t event, value_t val)
+{
+	struct test_builder* builder = user;
+	if (++builder->events == builder->abort_after)
+	{
+		return false;
+	}
+
+	switch (event)
+	{
+	case JSON_EVENT_START_OBJECT:
+	case JSON_EVENT_START_ARRAY:
+		assert(val.type == (event == JSON_EVENT_START_OBJECT ? TYPE_OBJECT : TYPE_ARRAY));
+		val = event == JSON_EVENT_START_OBJECT
+			? (value_t){ .type = TYPE_OBJECT, .data.object = hashmap_create() }
+			: (value_t){ .type = TYPE_ARRAY, .data.array = array_create() };
+		test_builder_add(builder, val);
+		assert(builder->depth < 256);
+		builder->keys[builder->depth] = NULL;
+		builder->stack[builder->depth++] = val;
+		break;
+	case JSON_EVENT_END_OBJECT:
+	case JSON_EVENT_END_ARRAY:
+		assert(builder->depth > 0);
+		assert(builder->stack[builder->depth - 1].type == (event == JSON_EVENT_END_OBJECT ? TYPE_OBJECT : TYPE_ARRAY));
+		assert(builder->keys[builder->depth - 1] == NULL);
+		builder->depth--;
+		break;
+	case JSON_EVENT_KEY:
+		assert(val.type == TYPE_STRING && builder->depth > 0 && builder->keys[builder->depth - 1] == NULL);
+		builder->keys[builder->depth - 1] = test_copy_string(val.data.string);
+		break;
+	case JSON_EVENT_VALUE:
+		if (val.type == TYPE_STRING)
+		{
+			val.data.string = test_copy_string(val.data.string);
+		}
+		test_builder_add(builder, val);
+		break;
+	}
+	return true;
+}
+
+/* frees what builder built, including what was left open by an error */
+static void test_builder_destroy(struct test_builder* builder)
+{
+	for (int i = 0; i < builder->depth; i++)
+	{
+		free(builder->keys[i]);
+	}
+	json_destroy(builder->root);
+}
+
+/* feeds raw to a stream chunk bytes at a time, or in random chunks when chunk is 0 */
+static json_state_t test_stream(const char* raw, json_settings_t settings, size_t chunk)
+{
+	json_stream_t stream = json_stream_create(settings, NULL, NULL);
+	assert(stream);
+	size_t length = strlen(raw);
+	for (size_t i = 0; i < length;)
+	{
+		size_t size = chunk > 0 ? chunk : 1 + (size_t)rand() % 16;
+		size = size < length - i ? size : length - i;
+		json_stream_feed(stream, raw + i, size);
+		i += size;
+	}
+	return json_stream_finish(stream);
+}
+
+/* checks a stream fed raw in chunks of every size up to 8 and some random ones agrees with json_parse */
+static void test_stream_agrees(const char* raw, json_settings_t settings, json_state_t expected)
+{
+	for (size_t chunk = 0; chunk <= 8; chunk++)
+	{
+		json_state_t streamed = test_stream(raw, settings, chunk);
+		assert(streamed.error == expected.error);
+		if (expected.error == JSON_ERROR_NONE)
+		{
+			assert(test_equal(expected.head, streamed.head));
+		}
+		else
+		{
+			assert(streamed.pos == expected.pos);
+		}
+		json_destroy_state(&streamed);
+	}
+}
+
+static bool test_path_collect(void* user, value_t val)
+{
+	array_push(*(array_t*)user, val);
+	return true;
+}
+
+static bool test_lines_stop(void* user, size_t line, json_state_t doc)
+{
+	int* seen = user;
+	assert(line == (size_t)*seen);
+	json_destroy_state(&doc);
+	return ++*seen < 5000;
+}
+
+/* whether the tape's value at index holds the same document as val. Of repeated keys, the tree keeps the last */
+static bool test_tape_equal(const tape_t* tape, size_t index, value_t val)
+{
+	value_t scalar = tape_get(tape, index);
+	if (scalar.type != val.type)
+	{
+		return false;
+	}
+	switch (val.type)
+	{
+	case TYPE_OBJECT:
+	{
+		int count = 0;
+		for (size_t member = tape_child(tape, index); member != TAPE_NONE; member = tape_next(tape, member + 1))
+		{
+			const char* key = tape_get(tape, member).data.string;
+			bool last = true;
+			for (size_t later = tape_next(tape, member + 1); later != TAPE_NONE && last; later = tape_next(tape, later + 1))
+			{
+				last = strcmp(tape_get(tape, later).data.string, key) != 0;
+			}
+			if (last)
+			{
+				if (!hashmap_exists(val.data.object, key) || !test_tape_equal(tape, member + 1, hashmap_get(val.data.object, key)))
+				{
+					return false;
+				}
+				count++;
+			}
+		}
+		return count == hashmap_count(val.data.object);
+	}
+	case TYPE_ARRAY:
+	{
+		int i = 0;
+		for (size_t element = tape_child(tape, index); element != TAPE_NONE; element = tape_next(tape, element), i++)
+		{
+			if (i >= array_count(val.data.array) || !test_tape_equal(tape, element, array_get(val.data.array, i)))
+			{
+				return false;
+			}
+		}
+		return i == array_count(val.data.array);
+	}
+	default:
+		return test_equal(scalar, val);
+	}
+}
+
+/* whether the lazy document's value at index holds the same document as val, built one scalar at a time */
+static bool test_lazy_equal(lazy_t* lazy, size_t index, value_t val)
+{
+	if (lazy_type(lazy, index) != (val.type == TYPE_INTEGER || val.type == TYPE_UINTEGER ? TYPE_NUMBER : val.type))
+	{
+		return false;
+	}
+	switch (val.type)
+	{
+	case TYPE_OBJECT:
+	{
+		int count = 0;
+		for (size_t member = lazy_child(lazy, index); member != LAZY_NONE; member = lazy_next(lazy, lazy_next(lazy, member)))
+		{
+			json_state_t key = lazy_get(lazy, member);
+			bool last = true;
+			for (size_t later = lazy_next(lazy, lazy_next(lazy, member)); later != LAZY_NONE && last; later = lazy_next(lazy, lazy_next(lazy, later)))
+			{
+				json_state_t other = lazy_get(lazy, later);
+				last = strcmp(other.head.data.string, key.head.data.string) != 0;
+				json_destroy_state(&other);
+			}
+			bool equal = !last || (hashmap_exists(val.data.object, key.head.data.string)
+				&& test_lazy_equal(lazy, lazy_next(lazy, member), hashmap_get(val.data.object, key.head.data.string)));
+			json_destroy_state(&key);
+			if (!equal)
+			{
+				return false;
+			}
+			count += last;
+		}
+		return count == hashmap_count(val.data.object);
+	}
+	case TYPE_ARRAY:
+	{
+		int i = 0;
+		for (size_t element = lazy_child(lazy, index); element != LAZY_NONE; element = lazy_next(lazy, element), i++)
+		{
+			if (i >= array_count(val.data.array) || !test_lazy_equal(lazy, element, array_get(val.data.array, i)))
+			{
+				return false;
+			}
+		}
+		return i == array_count(val.data.array);
+	}
+	default:
+	{
+		json_state_t scalar = lazy_get(lazy, index);
+		bool equal = scalar.error == JSON_ERROR_NONE && test_equal(scalar.head, val);
+		json_destroy_state(&scalar);
+		return equal;
+	}
+	}
+}
+
+/* parses raw with every engine and checks they agree on the tree or the error */
+static void test_engines_agree(const char* raw, json_settings_t settings)
+{
+	json_state_t bytewise = json_parse(raw, settings), indexed = json_parse_indexed(raw, settings);
+	struct test_builder builder = { 0 };
+	json_state_t events = json_parse_events(raw, settings, test_builder_handler, &builder);
+	tape_t tape = tape_parse(raw, settings);
+	assert(bytewise.error == indexed.error && bytewise.error == events.error && bytewise.error == tape.error);
+	assert(events.head.type == TYPE_NULL);
+	if (bytewise.error == JSON_ERROR_NONE)
+	{
+		assert(test_equal(bytewise.head, indexed.head));
+		assert(builder.depth == 0 && test_equal(bytewise.head, builder.root));
+		assert(test_tape_equal(&tape, TAPE_ROOT, bytewise.head) && tape_next(&tape, TAPE_ROOT) == TAPE_NONE);
+	}
+	else
+	{
+		assert(bytewise.pos == indexed.pos && bytewise.pos == events.pos && bytewise.pos == tape.pos);
+	}
+	tape_destroy(&tape);
+
+	/* walked value by value, then built whole, which is only where lazy documents report errors the walk didn't cross */
+	lazy_t lazy = lazy_open(raw, strlen(raw), settings);
+	if (bytewise.error == JSON_ERROR_NONE)
+	{
+		assert(lazy.error == JSON_ERROR_NONE && test_lazy_equal(&lazy, lazy.root, bytewise.head) && lazy.error == JSON_ERROR_NONE);
+	}
+	if (lazy.error == JSON_ERROR_NONE)
+	{
+		json_state_t whole = lazy_get(&lazy, lazy.root);
+		assert(whole.error == bytewise.error && (whole.error != JSON_ERROR_NONE ? whole.pos == bytewise.pos : test_equal(whole.head, bytewise.head)));
+		json_destroy_state(&whole);
+	}
+	lazy_close(&lazy);
+	test_stream_agrees(raw, settings, bytewise);
+	json_destroy_state(&bytewise);
+	json_destroy_state(&indexed);
+	test_builder_destroy(&builder);
+}
+
+#define TEST_CONCURRENT_MODES 4
+#define TEST_CONCURRENT_THREADS 8
+
+/* one document parsed and written back by many threads at once, each with the settings and indent of its mode */
+struct test_concurrent
+{
+	const char* raw;
+	json_settings_t settings[TEST_CONCURRENT_MODES];
+	int indents[TEST_CONCURRENT_MODES];
+	char* expected[TEST_CONCURRENT_MODES]; /* written by one thread alone before the others start */
+	size_t expected_length[TEST_CONCURRENT_MODES];
+	int next,
+		rounds,
+		failures;
+	mtx_t lock;
+};
+
+/* parses and writes the document of mode, returning what was written. The caller frees it */
+static char* test_concurrent_write(const struct test_concurrent* concurrent, int mode, size_t* length)
+{
+	json_state_t doc = json_parse(concurrent->raw, concurrent->settings[mode]);
+	json_writer_t writer = json_writer_create(NULL, concurrent->indents[mode]);
+	char* copy = NULL;
+	if (doc.error == JSON_ERROR_NONE && writer != NULL && json_writer_value(writer, doc.head))
+	{
+		const char* written = json_writer_data(writer, length);
+		copy = malloc(*length);
+		if (copy != NULL)
+		{
+			memcpy(copy, written, *length);
+		}
+	}
+	if (writer != NULL)
+	{
+		json_writer_destroy(writer);
+	}
+	json_destroy_state(&doc);
+	return copy;
+}
+
+static int test_concurrent_work(void* user)
+{
+	struct test_concurrent* concurrent = user;
+	mtx_lock(&concurrent->lock);
+	int mode = concurrent->next++ % TEST_CONCURRENT_MODES;
+	mtx_unlock(&concurrent->lock);
+
+	int failures = 0;
+	for (int i = 0; i < concurrent->rounds; i++)
+	{
+		size_t length;
+		char* written = test_concurrent_write(concurrent, mode, &length);
+		failures += written == NULL || length != concurrent->expected_length[mode]
+			|| memcmp(written, concurrent->expected[mode], length) != 0;
+		free(written);
+	}
+
+	mtx_lock(&concurrent->lock);
+	concurrent->failures += failures;
+	mtx_unlock(&concurrent->lock);
+	return 0;
+}
+
+/* passes allocations on to a counting allocator until budget of them have been made, then fails every one after */
+struct test_failing
+{
+	allocator_t counting;
+	int budget;
+};
+
+static void* test_failing_alloc(void* user, size_t size, alloc_kind_t kind)
+{
+	struct test_failing* failing = user;
+	return failing->budget-- > 0 ? failing->counting.alloc(failing->counting.user, size, kind) : NULL;
+}
+
+static void* test_failing_realloc(void* user, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind)
+{
+	struct test_failing* failing = user;
+	return failing->budget-- > 0 ? failing->counting.realloc(failing->counting.user, ptr, old_size, new_size, kind) : NULL;
+}
+
+static void test_failing_free(void* user, void* ptr, alloc_kind_t kind)
+{
+	struct test_failing* failing = user;
+	failing->counting.free(failing->counting.user, ptr, kind);
+}
 
 int main()
 {
 #if 1 /* basic object and array test */
 	{
-		json_document_t obj_parse = json_parse(
+		json_state_t obj_parse = json_parse(
 			"{"
 				"\"1st Str\": \"Basic string test\","
 				"\"2nd Str\": \"Escape sequence \\\"Quotes here\\\", \\\\ <- single backslash.\\nNew line\\tTab\\u000ANew line w/ hex escape sequence\","
@@ -17,25 +482,25 @@ int main()
 				"\"4th Num\": -1234.5678,"
 				"\"5th Num\": 1234.5678e4,"
 				"\"6th Num\": -1234.5678e-4"
-			"}");
+			"}", JSON_DEFAULT_SETTINGS);
 		assert(obj_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, obj_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t arr_parse = json_parse(
+		json_state_t arr_parse = json_parse(
 			"["
 				"\"Element 1\","
 				"\"Element 2\","
 				"\"Element 3\","
 				"4, 5, 6"
-			"]");
+			"]", JSON_DEFAULT_SETTINGS);
 		assert(arr_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, arr_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t obj_parse = json_parse(
+		json_state_t obj_parse = json_parse(
 			"{"
 				"\"Nested Object\": { "
 					"\"Key\": \"Value\""
@@ -43,69 +508,922 @@ int main()
 				"\"Nested Array\": [ "
 					"\"Element\""
 				"]"
-			"}");
+			"}", JSON_DEFAULT_SETTINGS);
 		assert(obj_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, obj_parse.head);
 	}
 #endif
 #if 0 /* json_parse_number test */
 	{
-		json_document_t number_parse = json_parse("12345678");
+		json_state_t number_parse = json_parse("12345678", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t number_parse = json_parse("-12345678");
+		json_state_t number_parse = json_parse("-12345678", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t number_parse = json_parse("1234.5678");
+		json_state_t number_parse = json_parse("1234.5678", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t number_parse = json_parse("-1234.5678");
+		json_state_t number_parse = json_parse("-1234.5678", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t number_parse = json_parse("1234.5678e4");
+		json_state_t number_parse = json_parse("1234.5678e4", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t number_parse = json_parse("-1234.5678e-4");
+		json_state_t number_parse = json_parse("-1234.5678e-4", JSON_DEFAULT_SETTINGS);
 		assert(number_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, number_parse.head);
 	}
 #endif
 #if 0 /* json_parse_string test */
 	{
-		json_document_t string_parse = json_parse("\"Basic string test\"");
+		json_state_t string_parse = json_parse("\"Basic string test\"", JSON_DEFAULT_SETTINGS);
 		assert(string_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, string_parse.head);
 	}
 	printf("\n\n");
 	{
-		json_document_t string_parse = json_parse("\"Escape sequence \\\"Quotes here\\\", \\\\ <- single backslash.\\nNew line\\tTab\\u000ANew line w/ hex escape sequence\"");
+		json_state_t string_parse = json_parse("\"Escape sequence \\\"Quotes here\\\", \\\\ <- single backslash.\\nNew line\\tTab\\u000ANew line w/ hex escape sequence\"", JSON_DEFAULT_SETTINGS);
 		assert(string_parse.error == JSON_ERROR_NONE);
 		json_write_value(stdout, string_parse.head);
 	}
 	{
-		json_document_t string_parse = json_parse("\"This will cause an error. \\ \"");
+		json_state_t string_parse = json_parse("\"This will cause an error. \\ \"", JSON_DEFAULT_SETTINGS);
 		assert(string_parse.error == JSON_ERROR_INVALID_ESCAPE_SEQUENCE);
 	}
 	{
-		json_document_t string_parse = json_parse("\"So will this.\\u000G \"");
+		json_state_t string_parse = json_parse("\"So will this.\\u000G \"", JSON_DEFAULT_SETTINGS);
 		assert(string_parse.error == JSON_ERROR_INVALID_HEX_DIGIT);
 	}
 #endif
+#if 1 /* arena test */
+	{
+		json_state_t arena_parse = json_parse(
+			"{"
+				"\"Long String\": \"This string is long enough to be grown inside of the arena a few times.\","
+				"\"Array\": [1, 2, 3, {\"Key\": \"Value\"}],"
+				"\"Object\": { \"Nested\": [ \"Element\" ] }"
+			"}", JSON_DEFAULT_SETTINGS | JSON_USE_ARENA);
+		assert(arena_parse.error == JSON_ERROR_NONE);
+		assert(arena_parse.arena != NULL);
+		assert(hashmap_count(arena_parse.head.data.object) == 3);
+		assert(array_count(hashmap_get(arena_parse.head.data.object, "Array").data.array) == 4);
+		json_write_value(stdout, arena_parse.head);
+		json_destroy_state(&arena_parse);
+		assert(arena_parse.arena == NULL);
+
+		json_state_t arena_error = json_parse("[1, 2, \"Unterminated\" 3]", JSON_DEFAULT_SETTINGS | JSON_USE_ARENA);
+		assert(arena_error.error != JSON_ERROR_NONE);
+		assert(arena_error.arena == NULL);
+	}
+#endif
+#if 1 /* in situ test */
+	{
+		char raw[] = "{\"Plain\": \"No escapes\", \"Esc\\naped\": \"Tab\\tQuote\\\"\\u0041\", \"Array\": [\"\", \"x\"]}";
+		json_state_t in_situ_parse = json_parse_in_situ(raw, JSON_DEFAULT_SETTINGS);
+		assert(in_situ_parse.error == JSON_ERROR_NONE);
+		assert(in_situ_parse.settings & JSON_IN_SITU);
+		char* plain = hashmap_get(in_situ_parse.head.data.object, "Plain").data.string;
+		assert(plain > raw && plain < raw + sizeof raw && strcmp(plain, "No escapes") == 0);
+		char* escaped = hashmap_get(in_situ_parse.head.data.object, "Esc\naped").data.string;
+		assert(escaped > raw && escaped < raw + sizeof raw && strcmp(escaped, "Tab\tQuote\"A") == 0);
+		array_t arr = hashmap_get(in_situ_parse.head.data.object, "Array").data.array;
+		assert(strcmp(array_get(arr, 0).data.string, "") == 0 && strcmp(array_get(arr, 1).data.string, "x") == 0);
+		json_destroy_state(&in_situ_parse);
+	}
+#endif
+#if 1 /* indexed engine test */
+	{
+		static const char* cases[] =
+		{
+			"{\"a\": [1, 2.5, -3e2, true, false, null, \"s\"], \"b\": {\"c\": {}}, \"d\": []}",
+			"  [ \"escaped \\\" quote\", \"\\\\\", \"\\\\\\\"\", \"brackets ]}[{:, in string\" ]  ",
+			"\"top level string\"", "12345", "-", "1.", "1e", "1.5.3", "truex", "true false", "nul", "[1 2]", "[1,]", "{\"a\" 1}",
+			"{\"a\":}", "{\"a\"}", "{1: 2}", "[\"a\" \"b\"]", "[\"a\"x]", "[1]x", "[1] [2]", "[", "]", "{", "\"unterminated",
+			"[\"tab\tinside\"]", "[\"bad \\x escape\"]", "[\\\"a\"]", "// comment\n[1]", "[1,\f2]", "[0x10]", "[-]", "[--1]",
+			"[101]", "", " ", "[\"\\u0041\\u00e9\"]", "[\"\\u00G1\"]", "{\"k\":\"v\",\"k\":\"w\"}", "[[[[[[]]]]]]",
+		};
+		for (int i = 0; i < sizeof cases / sizeof * cases; i++)
+		{
+			test_engines_agree(cases[i], JSON_DEFAULT_SETTINGS);
+		}
+
+		/* long documents that span several blocks and index windows, with one random byte broken */
+		static const char alphabet[] = "{}[]:,\"\\ \tn1-.e0tfa";
+		char* raw = malloc(512 * 1024);
+		srand(1);
+		for (int round = 0; round < 200; round++)
+		{
+			char* curr = raw;
+			curr += sprintf(curr, "[");
+			int items = rand() % (round < 190 ? 40 : 8000);
+			for (int j = 0; j < items; j++)
+			{
+				curr += sprintf(curr, j % 3 == 0 ? "{\"key %d\\\\\": [\"v\\\"%d\", %d.%de%d, true, null]}, " : j % 3 == 1 ? "\"%d\\\\\\\"%d\"  ,\n" : "%d.%d, ", j, j * 7, j, j, j % 5);
+			}
+			curr += sprintf(curr, "false]");
+			test_engines_agree(raw, JSON_DEFAULT_SETTINGS);
+			if (round % 2 == 1)
+			{
+				raw[rand() % (curr - raw)] = alphabet[rand() % (sizeof alphabet - 1)];
+				test_engines_agree(raw, JSON_DEFAULT_SETTINGS);
+			}
+		}
+
+		/* random soup of json-ish bytes */
+		for (int round = 0; round < 20000; round++)
+		{
+			int length = rand() % 48;
+			for (int j = 0; j < length; j++)
+			{
+				raw[j] = alphabet[rand() % (sizeof alphabet - 1)];
+			}
+			raw[length] = '\0';
+			for (scan_level_t level = SCAN_SCALAR; level <= scan_supported(); level++)
+			{
+				scan_select(level);
+				test_engines_agree(raw, JSON_DEFAULT_SETTINGS);
+			}
+		}
+		free(raw);
+	}
+#endif
+#if 1 /* number rounding test */
+	{
+		static const char* cases[] =
+		{
+			"0", "-0", "1", "-1", "101", "1.05", "0.1", "0.3", "123456789012345678", "12345678901234567890", "9007199254740993",
+			"1e23", "8.98846567431158e307", "1.7976931348623157e308", "1.7976931348623159e308", "1e309", "-1e400",
+			"2.2250738585072011e-308", "2.2250738585072012e-308", "4.9e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+			"1e-400", "0.000000000000000000000000000000000000000000001", "3.14159265358979323846264338327950288419716939937510",
+			"179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791",
+			"7.2057594037927933e16", "1448997445238699", "0.000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000123e3",
+			"1E5", "1e+5", "1e-5", "123.456e-2"
+		};
+		for (int i = 0; i < sizeof cases / sizeof * cases; i++)
+		{
+			json_state_t number_parse = json_parse(cases[i], JSON_DEFAULT_SETTINGS);
+			assert(number_parse.error == JSON_ERROR_NONE && number_parse.head.type == TYPE_NUMBER);
+			double expected = strtod(cases[i], NULL);
+			assert(memcmp(&number_parse.head.data.number, &expected, sizeof expected) == 0);
+		}
+
+		static const struct { const char* raw; json_error_t error; } invalid[] =
+		{
+			{ "-", JSON_ERROR_INVALID_NUMBER }, { "-a", JSON_ERROR_INVALID_NUMBER }, { "01", JSON_ERROR_LEADING_ZERO },
+			{ "-00", JSON_ERROR_LEADING_ZERO }, { "1.", JSON_ERROR_UNEXPECTED_TOKEN }, { "1.e5", JSON_ERROR_UNEXPECTED_TOKEN },
+			{ "1e", JSON_ERROR_UNEXPECTED_TOKEN }, { "1e+", JSON_ERROR_UNEXPECTED_TOKEN }, { "0x10", JSON_ERROR_UNEXPECTED_TOKEN }
+		};
+		for (int i = 0; i < sizeof invalid / sizeof * invalid; i++)
+		{
+			assert(json_parse(invalid[i].raw, JSON_DEFAULT_SETTINGS).error == invalid[i].error);
+		}
+
+		/* random digits, random doubles printed at random precisions, both compared bit for bit against strtod */
+		char number[96];
+		srand(2);
+		for (int i = 0; i < 1000000; i++)
+		{
+			if (i % 2 == 0)
+			{
+				int digits = 1 + rand() % 24, point = rand() % (digits + 1), length = 0;
+				for (int j = 0; j < digits; j++)
+				{
+					if (j == point && j > 0)
+					{
+						number[length++] = '.';
+					}
+					number[length++] = (char)((j == 0 ? '1' + rand() % 9 : '0' + rand() % 10));
+				}
+				sprintf(number + length, "e%d", rand() % 700 - 350);
+			}
+			else
+			{
+				uint64_t bits = (uint64_t)rand() << 48 ^ (uint64_t)rand() << 32 ^ (uint64_t)rand() << 16 ^ (uint64_t)rand();
+				double value;
+				memcpy(&value, &bits, sizeof value);
+				if (value != value || value - value != 0.0) /* nan and infinity aren't json */
+				{
+					continue;
+				}
+				sprintf(number, "%.*g", 1 + rand() % 18, value);
+			}
+
+			json_state_t number_parse = json_parse(number, JSON_DEFAULT_SETTINGS);
+			assert(number_parse.error == JSON_ERROR_NONE);
+			double expected = strtod(number, NULL);
+			assert(memcmp(&number_parse.head.data.number, &expected, sizeof expected) == 0);
+		}
+	}
+#endif
+#if 1 /* integer test */
+	{
+		json_settings_t settings = JSON_DEFAULT_SETTINGS | JSON_PARSE_INTEGERS;
+		static const struct { const char* raw; int64_t value; uint64_t uvalue; } integers[] =
+		{
+			{ "0", 0 }, { "-1", -1 }, { "101", 101 }, { "9007199254740993", 9007199254740993 },
+			{ "9223372036854775807", INT64_MAX }, { "-9223372036854775808", INT64_MIN },
+			{ "9223372036854775808", .uvalue = (uint64_t)INT64_MAX + 1 }, { "10000000000000000000", .uvalue = 10000000000000000000u },
+			{ "18446744073709551615", .uvalue = UINT64_MAX }
+		};
+		for (int i = 0; i < sizeof integers / sizeof * integers; i++)
+		{
+			json_state_t doc = json_parse(integers[i].raw, settings);
+			assert(doc.error == JSON_ERROR_NONE);
+			if (integers[i].uvalue != 0)
+			{
+				assert(doc.head.type == TYPE_UINTEGER && doc.head.data.uinteger == integers[i].uvalue);
+				assert(value_to_number(doc.head) == (double)integers[i].uvalue);
+			}
+			else
+			{
+				assert(doc.head.type == TYPE_INTEGER && doc.head.data.integer == integers[i].value);
+				assert(value_to_number(doc.head) == (double)integers[i].value);
+			}
+
+			/* written back the same way it was read */
+			char written[32] = { 0 };
+			FILE* out = tmpfile();
+			assert(out);
+			assert(json_write_value(out, doc.head));
+			rewind(out);
+			fread(written, 1, sizeof written - 1, out);
+			fclose(out);
+			assert(strcmp(written, integers[i].raw) == 0);
+		}
+
+		/* anything else stays a double */
+		static const char* doubles[] = { "-0", "1.0", "1e2", "18446744073709551615.0", "-9223372036854775809", "18446744073709551616",
+			"18446744073709551620", "99999999999999999999", "123456789012345678901234" };
+		for (int i = 0; i < sizeof doubles / sizeof * doubles; i++)
+		{
+			json_state_t doc = json_parse(doubles[i], settings);
+			double expected = strtod(doubles[i], NULL);
+			assert(doc.error == JSON_ERROR_NONE && doc.head.type == TYPE_NUMBER);
+			assert(memcmp(&doc.head.data.number, &expected, sizeof expected) == 0 && value_to_number(doc.head) == expected);
+		}
+
+		json_state_t doc = json_parse("01", settings);
+		assert(doc.error == JSON_ERROR_LEADING_ZERO);
+		doc = json_parse("-", settings);
+		assert(doc.error == JSON_ERROR_INVALID_NUMBER);
+		test_engines_agree("[1, -2, 3.5, {\"id\": 1234567890123456789}, 1e3, -0, 01]", settings);
+		test_engines_agree("[1, -2, 3.5, {\"id\": 1234567890123456789}, 1e3, -0]", settings);
+		test_engines_agree("[18446744073709551615, 9223372036854775808, 18446744073709551616, -9223372036854775808]", settings);
+
+		doc = json_parse("12", JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE && doc.head.type == TYPE_NUMBER && value_to_number(doc.head) == 12.0);
+	}
+#endif
+#if 1 /* event test */
+	{
+		/* one event per token, keys reported as keys */
+		struct test_builder builder = { 0 };
+		json_state_t doc = json_parse_events("{\"a\": [1, \"x\", true, null], \"b\": {}}", JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(doc.error == JSON_ERROR_NONE && builder.events == 12);
+		assert(hashmap_count(builder.root.data.object) == 2);
+		assert(array_count(hashmap_get(builder.root.data.object, "a").data.array) == 4);
+		json_destroy(builder.root);
+
+		/* a handler can stop the parse */
+		builder = (struct test_builder){ .abort_after = 3 };
+		doc = json_parse_events("[1, 2, 3]", JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(doc.error == JSON_ERROR_ABORTED && doc.pos == 4 && builder.events == 3);
+		test_builder_destroy(&builder);
+
+		/* the tokenizer knows keys from values, so these are no longer accepted by any engine */
+		static const char* invalid[] = { "{\"a\", \"b\"}", "{\"a\": \"b\": 1}", "[1}", "{\"a\": 1]", "{}, 1", "[]]", "{\"a\"}" };
+		for (int i = 0; i < sizeof invalid / sizeof * invalid; i++)
+		{
+			builder = (struct test_builder){ 0 };
+			doc = json_parse_events(invalid[i], JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+			assert(doc.error == JSON_ERROR_UNEXPECTED_TOKEN);
+			test_builder_destroy(&builder);
+			test_engines_agree(invalid[i], JSON_DEFAULT_SETTINGS);
+		}
+
+		/* strings longer than the scratch arena's block */
+		size_t length = 3 << 20;
+		char* raw = malloc(length + 5);
+		assert(raw);
+		memcpy(raw, "[\"", 2);
+		memset(raw + 2, 'x', length);
+		memcpy(raw + 2 + length, "\"]", 3);
+		test_engines_agree(raw, JSON_DEFAULT_SETTINGS);
+		free(raw);
+	}
+#endif
+#if 1 /* stream test */
+	{
+		/* cut at every position of a document full of tokens that can't be read a byte at a time */
+		const char* raw = "{\"esc\\\\aped\\\"\": \"\\u0041\\\\\\\"\\n\", \"n\": [-12.5e-3, 0, 1234567890123, 1E+2], \"l\": [true, false, null]}";
+		json_state_t expected = json_parse(raw, JSON_DEFAULT_SETTINGS);
+		assert(expected.error == JSON_ERROR_NONE);
+		size_t length = strlen(raw);
+		for (size_t cut = 0; cut <= length; cut++)
+		{
+			json_stream_t stream = json_stream_create(JSON_DEFAULT_SETTINGS, NULL, NULL);
+			assert(json_stream_feed(stream, raw, cut) == JSON_ERROR_NONE);
+			assert(json_stream_feed(stream, raw + cut, length - cut) == JSON_ERROR_NONE);
+			json_state_t streamed = json_stream_finish(stream);
+			assert(streamed.error == JSON_ERROR_NONE && test_equal(expected.head, streamed.head));
+			json_destroy_state(&streamed);
+		}
+		test_stream_agrees(raw, JSON_DEFAULT_SETTINGS, expected);
+		json_destroy_state(&expected);
+
+		/* comments and atoms cut off by the end of the document */
+		static const char* comments[] = { "[1, /* a/b * c */ 2] // end", "/**/1", "[1 /*/ 2 */]", "// only\n\"x\"", "[1] /* unterminated", "[1] /", "/x 1" };
+		for (int i = 0; i < sizeof comments / sizeof * comments; i++)
+		{
+			expected = json_parse(comments[i], JSON_DEFAULT_SETTINGS | JSON_ALLOW_COMMENTS);
+			test_stream_agrees(comments[i], JSON_DEFAULT_SETTINGS | JSON_ALLOW_COMMENTS, expected);
+			json_destroy_state(&expected);
+		}
+		static const char* cut_off[] = { "12", "-", "tru", "\"abc", "\"abc\\", "[1, 2" };
+		for (int i = 0; i < sizeof cut_off / sizeof * cut_off; i++)
+		{
+			expected = json_parse(cut_off[i], JSON_DEFAULT_SETTINGS);
+			test_stream_agrees(cut_off[i], JSON_DEFAULT_SETTINGS, expected);
+			json_destroy_state(&expected);
+		}
+
+		/* events arrive as tokens complete */
+		struct test_builder builder = { 0 };
+		json_stream_t stream = json_stream_create(JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		json_stream_feed(stream, "[\"ab", 4);
+		assert(builder.events == 1);
+		json_stream_feed(stream, "c\", 1", 5);
+		assert(builder.events == 2);
+		json_stream_feed(stream, "]", 1);
+		json_state_t doc = json_stream_finish(stream);
+		assert(doc.error == JSON_ERROR_NONE && builder.events == 4);
+		assert(strcmp(array_get(builder.root.data.array, 0).data.string, "abc") == 0);
+		json_destroy(builder.root);
+	}
+#endif
+#if 1 /* json_parse_n test */
+	{
+		/* the end of the range is the end of the document, whatever follows it */
+		json_state_t doc = json_parse_n("[1, 2]xyz", 6, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE && array_count(doc.head.data.array) == 2);
+		json_destroy_state(&doc);
+		doc = json_parse_n("12345", 2, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE && doc.head.data.number == 12.0);
+		doc = json_parse_n("true", 3, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_UNEXPECTED_TOKEN && doc.pos == 0);
+		doc = json_parse_n("\"abc\"", 4, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_UNEXPECTED_TOKEN);
+		doc = json_parse_n("[1, 2]", 0, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_MISC);
+
+		/* terminators inside the range */
+		doc = json_parse_n("[\"a\0b\"]", 7, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NULL_TERMINATOR && doc.pos == 1);
+		doc = json_parse_n("[1,\0 2]", 7, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_UNEXPECTED_TOKEN && doc.pos == 3);
+		doc = json_parse_n("[1]\0", 4, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_UNEXPECTED_TOKEN && doc.pos == 3);
+
+		/* a buffer with nothing after it, for the address sanitizer to watch */
+		const char* cases[] = { "{\"key\": [\"value\", -1.5e3, true, null]}", "\"unterminated \\\"", "-", "[1, 2", "nul", "123" };
+		for (int i = 0; i < sizeof cases / sizeof * cases; i++)
+		{
+			size_t length = strlen(cases[i]);
+			char* exact = malloc(length);
+			assert(exact);
+			memcpy(exact, cases[i], length);
+			json_state_t bounded = json_parse_n(exact, length, JSON_DEFAULT_SETTINGS), terminated = json_parse(cases[i], JSON_DEFAULT_SETTINGS);
+			assert(bounded.error == terminated.error && bounded.pos == terminated.pos);
+			assert(bounded.error != JSON_ERROR_NONE || test_equal(bounded.head, terminated.head));
+			json_destroy_state(&bounded);
+			json_destroy_state(&terminated);
+			free(exact);
+		}
+	}
+#endif
+#if 1 /* json_parse_lines test */
+	{
+		/* a few megabytes so lines are spread over several chunks, with errors, carriage returns and an empty line */
+		const int line_count = 60000;
+		char* raw = malloc((size_t)line_count * 96);
+		assert(raw);
+		char* curr = raw;
+		for (int i = 0; i < line_count; i++)
+		{
+			if (i % 1000 == 999)
+			{
+				curr += sprintf(curr, i % 2000 == 999 ? "{\"broken\": %d,}\n" : "\n", i);
+			}
+			else
+			{
+				curr += sprintf(curr, "{\"id\": %d, \"name\": \"line %d\", \"tags\": [1, 2.5, true, null]}%s\n", i, i, i % 3 ? "" : "\r");
+			}
+		}
+		size_t length = (size_t)(curr - raw);
+
+		int threads[] = { 1, 3, 0 };
+		for (int t = 0; t < sizeof threads / sizeof * threads; t++)
+		{
+			size_t count;
+			json_state_t* docs = json_parse_lines_all(raw, length, JSON_DEFAULT_SETTINGS, threads[t], &count);
+			assert(docs != NULL && count == (size_t)line_count);
+			const char* line = raw;
+			for (size_t i = 0; i < count; i++)
+			{
+				const char* newline = memchr(line, '\n', (size_t)(raw + length - line));
+				json_state_t expected = json_parse_n(line, (size_t)(newline - line), JSON_DEFAULT_SETTINGS);
+				assert(docs[i].error == expected.error && docs[i].pos == expected.pos);
+				assert(expected.error != JSON_ERROR_NONE || test_equal(docs[i].head, expected.head));
+				assert((i % 1000 == 999) == (expected.error != JSON_ERROR_NONE));
+				json_destroy_state(&expected);
+				json_destroy_state(&docs[i]);
+				line = newline + 1;
+			}
+			free(docs);
+		}
+
+		/* without the trailing newline the last line is still a line, an empty buffer has none */
+		size_t count;
+		json_state_t* docs = json_parse_lines_all("1\n[2]\n\"3\"", 9, JSON_DEFAULT_SETTINGS, 2, &count);
+		assert(docs != NULL && count == 3 && docs[2].error == JSON_ERROR_NONE && docs[2].head.type == TYPE_STRING);
+		for (size_t i = 0; i < count; i++)
+		{
+			json_destroy_state(&docs[i]);
+		}
+		free(docs);
+		docs = json_parse_lines_all("", 0, JSON_DEFAULT_SETTINGS, 2, &count);
+		assert(count == 0);
+		free(docs);
+
+		/* a handler stopping early */
+		int seen = 0;
+		assert(!json_parse_lines(raw, length, JSON_DEFAULT_SETTINGS, 3, test_lines_stop, &seen));
+		assert(seen == 5000);
+		free(raw);
+	}
+#endif
+#if 1 /* interning test */
+	{
+		json_settings_t interning = JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_INTERN_KEYS | JSON_INTERN_STRINGS;
+		const char* raw = "[{\"id\": 1, \"kind\": \"event\", \"note\": \"a string much too long to be interned\"},"
+			"{\"id\": 2, \"kind\": \"event\", \"note\": \"a string much too long to be interned\"}]";
+		json_state_t doc = json_parse(raw, interning);
+		assert(doc.error == JSON_ERROR_NONE);
+		value_t first = array_get(doc.head.data.array, 0), second = array_get(doc.head.data.array, 1);
+		assert(hashmap_get(first.data.object, "kind").data.string == hashmap_get(second.data.object, "kind").data.string);
+		assert(hashmap_get(first.data.object, "note").data.string != hashmap_get(second.data.object, "note").data.string);
+		json_destroy_state(&doc);
+
+		/* equal trees whether or not strings are interned, from every engine, in situ, and past the inline object size */
+		const char* docs[] = {
+			raw,
+			"{\"a\": 1, \"b\": 2, \"c\": 3, \"d\": 4, \"e\": 5, \"f\": 6, \"g\": 7, \"h\": 8, \"i\": {\"a\": \"a\"}, \"j\": [\"b\", \"b\"]}",
+			"[{\"\\u0041\": \"x\"}, {\"A\": \"\\u0078\"}, {\"A\": 1, \"A\": 2}]"
+		};
+		for (int i = 0; i < sizeof docs / sizeof * docs; i++)
+		{
+			json_state_t plain = json_parse(docs[i], JSON_DEFAULT_SETTINGS | JSON_USE_ARENA);
+			test_engines_agree(docs[i], interning);
+			json_state_t interned = json_parse(docs[i], interning);
+			char* copy = test_copy_string(docs[i]);
+			json_state_t in_situ = json_parse_in_situ(copy, interning);
+			assert(plain.error == JSON_ERROR_NONE && test_equal(plain.head, interned.head) && test_equal(plain.head, in_situ.head));
+			json_destroy_state(&plain);
+			json_destroy_state(&interned);
+			json_destroy_state(&in_situ);
+			free(copy);
+		}
+	}
+#endif
+#if 1 /* number_write_double test */
+	{
+		/* shortest digits, integers without a fraction, exponents only outside of 1e-6 to 1e21 */
+		const double values[] = { 1e-7, 0.1, 0.3, 1.5, 100.0, -0.0, 1e21, 1e22, 123456789012345678.0, 5e-324, 1.7976931348623157e308, 0.000001, -1234.5678e-4 };
+		const char* expected[] = { "1e-7", "0.1", "0.3", "1.5", "100", "-0", "1e21", "1e22", "123456789012345680", "5e-324", "1.7976931348623157e308", "0.000001", "-0.12345678" };
+		for (int i = 0; i < sizeof values / sizeof * values; i++)
+		{
+			char digits[NUMBER_DOUBLE_SIZE + 1];
+			digits[number_write_double(values[i], digits)] = '\0';
+			assert(strcmp(digits, expected[i]) == 0);
+		}
+
+		/* every double read back bit for bit, here ones spread over the whole range of exponents */
+		uint64_t bits = 0x243F6A8885A308D3;
+		for (int i = 0; i < 100000; i++)
+		{
+			bits ^= bits << 13;
+			bits ^= bits >> 7;
+			bits ^= bits << 17;
+			double value;
+			memcpy(&value, &bits, sizeof value);
+			if (value - value != 0.0)
+			{
+				continue; /* infinity or nan */
+			}
+			char digits[NUMBER_DOUBLE_SIZE + 1];
+			size_t length = number_write_double(value, digits);
+			assert(length < NUMBER_DOUBLE_SIZE);
+			digits[length] = '\0';
+			json_state_t doc = json_parse(digits, JSON_DEFAULT_SETTINGS);
+			assert(doc.error == JSON_ERROR_NONE && memcmp(&doc.head.data.number, &value, sizeof value) == 0);
+		}
+	}
+#endif
+#if 1 /* tape test */
+	{
+		tape_t tape = tape_parse("{\"a\": [1, {\"deep\": [[], {}]}, \"x\"], \"b\": 2.5, \"c\": {}, \"d\": null}", JSON_DEFAULT_SETTINGS);
+		assert(tape.error == JSON_ERROR_NONE && tape_type(&tape, TAPE_ROOT) == TYPE_OBJECT);
+
+		/* walking the root's members skips whole subtrees */
+		const char* keys[] = { "a", "b", "c", "d" };
+		int i = 0;
+		for (size_t member = tape_child(&tape, TAPE_ROOT); member != TAPE_NONE; member = tape_next(&tape, tape_next(&tape, member)), i++)
+		{
+			assert(strcmp(tape_get(&tape, member).data.string, keys[i]) == 0);
+		}
+		assert(i == 4);
+
+		size_t a = tape_find(&tape, TAPE_ROOT, "a");
+		assert(tape_type(&tape, a) == TYPE_ARRAY);
+		size_t first = tape_child(&tape, a), second = tape_next(&tape, first), third = tape_next(&tape, second);
+		assert(value_to_number(tape_get(&tape, first)) == 1.0);
+		assert(tape_type(&tape, second) == TYPE_OBJECT && strcmp(tape_get(&tape, third).data.string, "x") == 0);
+		assert(tape_next(&tape, third) == TAPE_NONE);
+		size_t deep = tape_find(&tape, second, "deep");
+		assert(tape_child(&tape, tape_child(&tape, deep)) == TAPE_NONE);
+		assert(tape_get(&tape, tape_find(&tape, TAPE_ROOT, "b")).data.number == 2.5);
+		assert(tape_child(&tape, tape_find(&tape, TAPE_ROOT, "c")) == TAPE_NONE);
+		assert(tape_type(&tape, tape_find(&tape, TAPE_ROOT, "d")) == TYPE_NULL);
+		assert(tape_find(&tape, TAPE_ROOT, "e") == TAPE_NONE && tape_find(&tape, a, "a") == TAPE_NONE);
+		tape_destroy(&tape);
+
+		tape = tape_parse("\"lone\"", JSON_DEFAULT_SETTINGS);
+		assert(tape.error == JSON_ERROR_NONE && strcmp(tape_get(&tape, TAPE_ROOT).data.string, "lone") == 0);
+		assert(tape_child(&tape, TAPE_ROOT) == TAPE_NONE && tape_next(&tape, TAPE_ROOT) == TAPE_NONE);
+		tape_destroy(&tape);
+
+		tape = tape_parse("[1, 2", JSON_DEFAULT_SETTINGS);
+		assert(tape.error != JSON_ERROR_NONE && tape.words == NULL);
+	}
+#endif
+#if 1 /* lazy test */
+	{
+		const char* raw = " {\"skip\": {\"a\": [1, \"]}\\\"\", {\"b\": null}], \"c\": \"{\"}, \"k\\u0065y\": [10, 20.5, \"x\"], \"dup\": 1, \"dup\": 2} ";
+		lazy_t lazy = lazy_open(raw, strlen(raw), JSON_DEFAULT_SETTINGS | JSON_PARSE_INTEGERS);
+		assert(lazy.error == JSON_ERROR_NONE && lazy.root == 1 && lazy_type(&lazy, lazy.root) == TYPE_OBJECT);
+
+		/* brackets and quotes inside skipped strings don't end the subtree, escaped keys are decoded to compare */
+		size_t key = lazy_find(&lazy, lazy.root, "key");
+		assert(key != LAZY_NONE && lazy_type(&lazy, key) == TYPE_ARRAY);
+		json_state_t element = lazy_get(&lazy, lazy_at(&lazy, key, 1));
+		assert(element.error == JSON_ERROR_NONE && element.head.type == TYPE_NUMBER && element.head.data.number == 20.5);
+		json_destroy_state(&element);
+		element = lazy_get(&lazy, lazy_at(&lazy, key, 0));
+		assert(element.error == JSON_ERROR_NONE && element.head.type == TYPE_INTEGER && element.head.data.integer == 10);
+		json_destroy_state(&element);
+		assert(lazy_at(&lazy, key, 3) == LAZY_NONE && lazy_find(&lazy, key, "key") == LAZY_NONE);
+		assert(lazy_find(&lazy, lazy.root, "missing") == LAZY_NONE && lazy.error == JSON_ERROR_NONE);
+		json_state_t first = lazy_get(&lazy, lazy_find(&lazy, lazy.root, "dup"));
+		assert(first.head.type == TYPE_INTEGER && first.head.data.integer == 1);
+		json_destroy_state(&first);
+		json_state_t missing = lazy_get(&lazy, LAZY_NONE);
+		assert(missing.error == JSON_ERROR_EXPECTED_VALUE && lazy.error == JSON_ERROR_NONE);
+		lazy_close(&lazy);
+
+		/* nothing after the field asked for is looked at, errors are met as they are walked */
+		raw = "{\"a\": {\"deep\": [true]}, \"b\": 2, \"c\": [1 2 garbage";
+		lazy = lazy_open(raw, strlen(raw), JSON_DEFAULT_SETTINGS);
+		size_t b = lazy_find(&lazy, lazy.root, "b");
+		json_state_t value = lazy_get(&lazy, b);
+		assert(value.error == JSON_ERROR_NONE && value.head.data.number == 2.0);
+		json_destroy_state(&value);
+		assert(lazy_find(&lazy, lazy_find(&lazy, lazy.root, "a"), "deep") != LAZY_NONE);
+		size_t c = lazy_find(&lazy, lazy.root, "c");
+		assert(lazy.error == JSON_ERROR_NONE && lazy_child(&lazy, c) != LAZY_NONE);
+		assert(lazy_next(&lazy, lazy_child(&lazy, c)) == LAZY_NONE && lazy.error == JSON_ERROR_UNEXPECTED_TOKEN);
+		assert(lazy_find(&lazy, lazy.root, "a") == LAZY_NONE);
+		lazy_close(&lazy);
+
+		/* comments are skipped like whitespace when allowed */
+		raw = "/* a */ {\"x\": [1, /* ] */ 2], // }\n \"y\": 3}";
+		lazy = lazy_open(raw, strlen(raw), JSON_DEFAULT_SETTINGS | JSON_ALLOW_COMMENTS);
+		value = lazy_get(&lazy, lazy_find(&lazy, lazy.root, "y"));
+		assert(value.error == JSON_ERROR_NONE && value.head.data.number == 3.0);
+		json_destroy_state(&value);
+		lazy_close(&lazy);
+		lazy = lazy_open(raw, strlen(raw), JSON_DEFAULT_SETTINGS);
+		assert(lazy.error == JSON_ERROR_COMMENTS_DISABLED && lazy.root == LAZY_NONE);
+		lazy_close(&lazy);
+		lazy = lazy_open(" ", 1, JSON_DEFAULT_SETTINGS);
+		assert(lazy.error == JSON_ERROR_EXPECTED_VALUE);
+		lazy_close(&lazy);
+	}
+#endif
+#if 1 /* path test */
+	{
+		const char* raw = "{\"items\": [{\"id\": 1, \"tags\": [\"a\"]}, {\"id\": 2, \"tags\": []}, {\"id\": 3}], \"a/b\": {\"m~n\": true}, "
+			"\"10\": \"key\", \"\": 0, \"list\": [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10]}";
+		json_state_t doc = json_parse(raw, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE);
+
+		/* escapes, numeric tokens read as keys of objects and indexes of arrays, the empty key and the whole document */
+		const char* pointers[] = { "/items/1/id", "/a~1b/m~0n", "/10", "/list/10", "/", "" };
+		const char* expected[] = { "2", "true", "\"key\"", "10", "0", NULL };
+		for (int i = 0; i < sizeof pointers / sizeof * pointers; i++)
+		{
+			path_t path = path_compile(pointers[i]);
+			assert(path);
+			value_t val;
+			assert(path_get(path, doc.head, &val));
+			if (expected[i] != NULL)
+			{
+				json_state_t want = json_parse(expected[i], JSON_DEFAULT_SETTINGS);
+				assert(test_equal(val, want.head));
+				json_destroy_state(&want);
+			}
+			else
+			{
+				assert(val.type == TYPE_OBJECT && val.data.object == doc.head.data.object);
+			}
+			path_destroy(path);
+		}
+
+		const char* misses[] = { "/items/3", "/items/-", "/items/01", "/list/x", "/missing", "/items/0/id/deeper", "/10/0" };
+		for (int i = 0; i < sizeof misses / sizeof * misses; i++)
+		{
+			path_t path = path_compile(misses[i]);
+			value_t val;
+			assert(path && !path_get(path, doc.head, &val));
+			path_destroy(path);
+		}
+		const char* invalid[] = { "items", "/~2", "/a~" };
+		for (int i = 0; i < sizeof invalid / sizeof * invalid; i++)
+		{
+			assert(path_compile(invalid[i]) == NULL);
+		}
+
+		/* wildcards, on the tree and on events, where only the matches are handed on */
+		path_t path = path_compile("/items/*/id");
+		assert(path && path_length(path) == 3);
+		array_t found = array_create();
+		assert(path_select(path, doc.head, test_path_collect, &found) && array_count(found) == 3);
+		assert(array_get(found, 2).data.number == 3.0);
+		struct test_builder builder = { 0 };
+		json_state_t events = path_parse_events(path, raw, JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(events.error == JSON_ERROR_NONE && builder.events == 3 && builder.root.data.number == 3.0);
+		path_destroy(path);
+		array_destroy(found);
+
+		path = path_compile("/items/*/tags");
+		found = array_create();
+		assert(path_select(path, doc.head, test_path_collect, &found) && array_count(found) == 2);
+		builder = (struct test_builder){ 0 };
+		events = path_parse_events(path, raw, JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(events.error == JSON_ERROR_NONE && builder.events == 5 && builder.depth == 0);
+		assert(test_equal(builder.root, array_get(found, 1)));
+		json_destroy(builder.root);
+		path_destroy(path);
+		array_destroy(found);
+
+		path = path_compile("");
+		builder = (struct test_builder){ 0 };
+		events = path_parse_events(path, raw, JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(events.error == JSON_ERROR_NONE && test_equal(builder.root, doc.head));
+		json_destroy(builder.root);
+		path_destroy(path);
+
+		/* errors are the parser's */
+		path = path_compile("/a");
+		events = path_parse_events(path, "{\"a\": [1,]}", JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(events.error == JSON_ERROR_UNEXPECTED_TOKEN && events.pos == 9);
+		path_destroy(path);
+		json_destroy_state(&doc);
+	}
+#endif
+#if 1 /* json_writer test */
+	{
+		/* small objects keep their order, so compact output is exact */
+		json_state_t doc = json_parse("{\"a\": [1, 2.5, true, null], \"s\": \"q\\\"b\\\\c\\u0001\\n\u00e9\", \"e\": {}, \"f\": []}", JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE);
+		json_writer_t writer = json_writer_create(NULL, JSON_WRITER_COMPACT);
+		assert(writer && json_writer_value(writer, doc.head));
+		size_t length;
+		const char* written = json_writer_data(writer, &length);
+		const char expected[] = "{\"a\":[1,2.5,true,null],\"s\":\"q\\\"b\\\\c\\u0001\\n\u00e9\",\"e\":{},\"f\":[]}";
+		assert(length == sizeof expected - 1 && memcmp(written, expected, length) == 0);
+		json_writer_destroy(writer);
+
+		/* each level of nesting is indented by the writer's own width */
+		writer = json_writer_create(NULL, 2);
+		assert(writer && json_writer_value(writer, hashmap_get(doc.head.data.object, "a")));
+		written = json_writer_data(writer, &length);
+		const char indented[] = "[\n  1,\n  2.5,\n  true,\n  null\n]";
+		assert(length == sizeof indented - 1 && memcmp(written, indented, length) == 0);
+		json_writer_destroy(writer);
+		json_destroy_state(&doc);
+
+		/* every mode reads back to the same tree, through buffers much larger than the writer's */
+		char* raw = test_records(20000);
+		doc = json_parse(raw, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE);
+		const int indents[] = { JSON_WRITER_COMPACT, 1, 4, 8 };
+		for (int i = 0; i < sizeof indents / sizeof * indents; i++)
+		{
+			writer = json_writer_create(NULL, indents[i]);
+			assert(writer && json_writer_value(writer, doc.head));
+			written = json_writer_data(writer, &length);
+			json_state_t back = json_parse_n(written, length, JSON_DEFAULT_SETTINGS);
+			assert(back.error == JSON_ERROR_NONE && test_equal(doc.head, back.head));
+			json_destroy_state(&back);
+			json_writer_destroy(writer);
+		}
+		json_destroy_state(&doc);
+		free(raw);
+	}
+#endif
+#if 1 /* concurrency test */
+	{
+		/* threads with different settings and indents at once get what each would get alone */
+		char* raw = test_records(500);
+		struct test_concurrent concurrent = {
+			.raw = raw,
+			.settings = { JSON_DEFAULT_SETTINGS, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_PARSE_INTEGERS,
+				JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_INTERN_KEYS | JSON_INTERN_STRINGS, JSON_DEFAULT_SETTINGS | JSON_PARSE_INTEGERS },
+			.indents = { JSON_WRITER_COMPACT, 2, 4, 8 },
+			.rounds = 20
+		};
+		for (int mode = 0; mode < TEST_CONCURRENT_MODES; mode++)
+		{
+			concurrent.expected[mode] = test_concurrent_write(&concurrent, mode, &concurrent.expected_length[mode]);
+			assert(concurrent.expected[mode] != NULL);
+		}
+		assert(mtx_init(&concurrent.lock, mtx_plain) == thrd_success);
+		pool_t pool = pool_start(TEST_CONCURRENT_THREADS, test_concurrent_work, &concurrent);
+		assert(pool);
+		pool_join(pool);
+		mtx_destroy(&concurrent.lock);
+		assert(concurrent.next == TEST_CONCURRENT_THREADS && concurrent.failures == 0);
+		for (int mode = 0; mode < TEST_CONCURRENT_MODES; mode++)
+		{
+			free(concurrent.expected[mode]);
+		}
+		free(raw);
+	}
+#endif
+#if 1 /* allocator test */
+	{
+		/* every allocation of a document goes through its allocator, counted by kind, and all of it comes back */
+		const char* raw = "{\"name\": \"x\", \"tags\": [\"a\", \"bcd\", 2], \"nested\": {\"deep\": [[], {}]}}";
+		alloc_counts_t counts = { 0 };
+		allocator_t counting = allocator_counting(&counts);
+		json_state_t plain = json_parse(raw, JSON_DEFAULT_SETTINGS),
+			counted = json_parse_with(raw, JSON_DEFAULT_SETTINGS, &counting);
+		assert(counted.error == JSON_ERROR_NONE && test_equal(plain.head, counted.head));
+		assert(counts.calls[ALLOC_STRING] == 3 && counts.calls[ALLOC_KEY] == 4 && counts.calls[ALLOC_ARENA] == 0);
+		assert(counts.bytes[ALLOC_STRING] > 0 && counts.bytes[ALLOC_KEY] > 0 && counts.bytes[ALLOC_OBJECT] > 0 && counts.bytes[ALLOC_ARRAY] > 0);
+		json_destroy_state(&counted);
+		json_destroy_state(&plain);
+		assert(alloc_counts_bytes(&counts) == 0 && counts.frees[ALLOC_STRING] == 3 && counts.frees[ALLOC_KEY] == 4);
+
+		/* with an arena, nodes come from its blocks and only the blocks and the parser's working arrays are allocated */
+		counts = (alloc_counts_t){ 0 };
+		counted = json_parse_with(raw, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_INTERN_KEYS, &counting);
+		assert(counted.error == JSON_ERROR_NONE && counts.calls[ALLOC_ARENA] > 0);
+		assert(counts.calls[ALLOC_STRING] == 0 && counts.calls[ALLOC_KEY] == 0);
+		json_destroy_state(&counted);
+		assert(alloc_counts_bytes(&counts) == 0);
+
+		const char* broken[] = { "{\"a\": [\"b\", {\"c\": \"unterminated", "[\"a\", \"b\"] garbage" };
+		for (int i = 0; i < sizeof broken / sizeof * broken; i++)
+		{
+			counts = (alloc_counts_t){ 0 };
+			counted = json_parse_with(broken[i], JSON_DEFAULT_SETTINGS, &counting);
+			assert(counted.error != JSON_ERROR_NONE);
+			json_destroy_state(&counted);
+			assert(alloc_counts_bytes(&counts) == 0);
+		}
+
+		/* documents cut into chunks get the same nodes and strings, the stream's carry is allocated as a string */
+		counts = (alloc_counts_t){ 0 };
+		plain = json_parse(raw, JSON_DEFAULT_SETTINGS);
+		counted = json_parse_n_with(raw, strlen(raw), JSON_DEFAULT_SETTINGS, &counting);
+		assert(counted.error == JSON_ERROR_NONE && test_equal(plain.head, counted.head) && counts.calls[ALLOC_KEY] == 4);
+		json_destroy_state(&counted);
+		json_destroy_state(&plain);
+		assert(alloc_counts_bytes(&counts) == 0);
+
+		counts = (alloc_counts_t){ 0 };
+		json_stream_t stream = json_stream_create_with(JSON_DEFAULT_SETTINGS, NULL, NULL, &counting);
+		assert(stream != NULL);
+		for (size_t i = 0, length = strlen(raw); i < length; i += 5)
+		{
+			json_stream_feed(stream, raw + i, length - i < 5 ? length - i : 5);
+		}
+		counted = json_stream_finish(stream);
+		assert(counted.error == JSON_ERROR_NONE && counts.calls[ALLOC_STRING] > 3 && counts.calls[ALLOC_KEY] == 4);
+		json_destroy_state(&counted);
+		assert(alloc_counts_bytes(&counts) == 0);
+
+		counts = (alloc_counts_t){ 0 };
+		counted = json_parse_n_with(broken[0], strlen(broken[0]), JSON_DEFAULT_SETTINGS, &counting);
+		assert(counted.error != JSON_ERROR_NONE);
+		json_destroy_state(&counted);
+		assert(alloc_counts_bytes(&counts) == 0);
+
+		/* a repeated key keeps its last value, the values and copies of the key it shadows are given back */
+		counts = (alloc_counts_t){ 0 };
+		counted = json_parse_with("{\"a\": \"x\", \"a\": [\"y\"], \"b\": 1, \"a\": {\"a\": \"z\", \"a\": \"w\"}}", JSON_DEFAULT_SETTINGS, &counting);
+		assert(counted.error == JSON_ERROR_NONE && hashmap_count(counted.head.data.object) == 2);
+		value_t last = hashmap_get(counted.head.data.object, "a");
+		assert(last.type == TYPE_OBJECT && strcmp(hashmap_get(last.data.object, "a").data.string, "w") == 0);
+		json_destroy_state(&counted);
+		for (int kind = 0; kind < ALLOC_KIND_COUNT; kind++)
+		{
+			assert(counts.bytes[kind] == 0);
+		}
+
+		/* running out of memory at any allocation is an error, and whatever was built by then is given back */
+		const char* nested = "{\"a\": [], \"b\": [{}, [\"c\"], {\"d\": {\"e\": 1}}], \"f\": {\"g\": [\"h\", {}]}}";
+		struct test_failing failing = { .counting = counting };
+		allocator_t failing_allocator = { .alloc = test_failing_alloc, .realloc = test_failing_realloc, .free = test_failing_free, .user = &failing };
+		json_settings_t failing_settings[] = { JSON_DEFAULT_SETTINGS, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_INTERN_KEYS };
+		for (int i = 0; i < sizeof failing_settings / sizeof * failing_settings; i++)
+		{
+			for (int budget = 0;; budget++)
+			{
+				counts = (alloc_counts_t){ 0 };
+				failing.budget = budget;
+				counted = json_parse_with(nested, failing_settings[i], &failing_allocator);
+				assert(counted.error == JSON_ERROR_NONE || counted.error == JSON_ERROR_SYSTEM);
+				json_error_t error = counted.error;
+				json_destroy_state(&counted);
+				for (int kind = 0; kind < ALLOC_KIND_COUNT; kind++)
+				{
+					assert(counts.bytes[kind] == 0); /* keys are given back as keys, strings as strings */
+				}
+				if (error == JSON_ERROR_NONE)
+				{
+					break;
+				}
+			}
+		}
+	}
+#endif
+#ifdef JSON_STATS /* statistics test */
+	{
+		const char* raw = "{\"name\": \"x\", \"tags\": [\"a\", \"bcd\", 2, true, null], \"nested\": {\"deep\": [[], {}]}, \"n\": -1.5}";
+		alloc_counts_t counts = { 0 };
+		allocator_t counting = allocator_counting(&counts);
+		json_state_t doc = json_parse_with(raw, JSON_DEFAULT_SETTINGS, &counting);
+		json_stats_t stats = doc.stats;
+		assert(doc.error == JSON_ERROR_NONE);
+		assert(stats.objects == 3 && stats.arrays == 3 && stats.strings == 3 && stats.keys == 5 && stats.numbers == 2 && stats.literals == 2);
+		assert(stats.string_bytes == 24 && stats.max_depth == 4);
+		assert(stats.hashmap_resizes == 0 && stats.probes == 11 && stats.longest_probe == 4); /* inline maps of 4, 1 and 0 keys */
+		/* containers are counted at what they hold, strings at their length, so only those differ from what was allocated */
+		assert(stats.bytes == json_memory_usage(doc.head)
+			&& stats.bytes == counts.bytes[ALLOC_ARRAY] + counts.bytes[ALLOC_OBJECT] + stats.string_bytes + stats.strings + stats.keys);
+		size_t tags = json_memory_usage(hashmap_get(doc.head.data.object, "tags"));
+		assert(tags > 0 && tags < stats.bytes && json_memory_usage((value_t) { .type = TYPE_NUMBER }) == 0);
+		json_destroy_state(&doc);
+
+		/* arena documents hold their blocks, events are counted but nothing is held */
+		counts = (alloc_counts_t){ 0 };
+		doc = json_parse_with(raw, JSON_DEFAULT_SETTINGS | JSON_USE_ARENA, &counting);
+		assert(doc.error == JSON_ERROR_NONE && doc.stats.bytes == counts.bytes[ALLOC_ARENA] && doc.stats.objects == 3);
+		json_destroy_state(&doc);
+		struct test_builder builder = { 0 };
+		doc = json_parse_events(raw, JSON_DEFAULT_SETTINGS, test_builder_handler, &builder);
+		assert(doc.error == JSON_ERROR_NONE && doc.stats.keys == 5 && doc.stats.max_depth == 4 && doc.stats.bytes == 0);
+		json_destroy(builder.root);
+
+		/* a wide object is a table, probed from each key's home slot */
+		char* wide = test_records(1);
+		doc = json_parse(wide, JSON_DEFAULT_SETTINGS);
+		assert(doc.error == JSON_ERROR_NONE && doc.stats.probes >= doc.stats.keys && doc.stats.longest_probe >= 1);
+		json_destroy_state(&doc);
+		free(wide);
+
+		doc = json_parse("[1, 2, {\"a\": ", JSON_DEFAULT_SETTINGS);
+		assert(doc.error != JSON_ERROR_NONE && doc.stats.numbers == 2 && doc.stats.keys == 1 && doc.stats.bytes == 0);
+	}
+#endif
 #if 0 /* json_write_value test */
 	value_t obj = { .type = TYPE_OBJECT, .data.object = hashmap_create() };
 	{
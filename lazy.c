@@ -0,0 +1,378 @@
+/*
+	lazy.c ~ RL
+	On-demand access to documents, walking their text only as far as asked.
+*/
+
+#include <malloc.h>
+#include <string.h>
+#include "lazy.h"
+#include "scan.h"
+
+#define LAZY_WINDOW 4096 /* most bytes indexed at once while skipping a container */
+
+static size_t lazy_fail(lazy_t* lazy, size_t offset, json_error_t error)
+{
+	if (lazy->error == JSON_ERROR_NONE)
+	{
+		lazy->error = error;
+		lazy->pos = (int)offset;
+	}
+	return LAZY_NONE;
+}
+
+static inline bool lazy_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool lazy_is_atom_end(char c)
+{
+	return lazy_is_space(c) || c == ',' || c == ']' || c == '}' || c == ':' || c == '/' || c == '\0';
+}
+
+/* byte at index, or a terminator for LAZY_NONE so that nothing is found there */
+static inline char lazy_byte(const lazy_t* lazy, size_t index)
+{
+	return index < lazy->length ? lazy->raw[index] : '\0';
+}
+
+/* offset of the first byte at or after offset that isn't whitespace or a comment, which may be length */
+static size_t lazy_skip_space(lazy_t* lazy, size_t offset)
+{
+	const char* raw = lazy->raw;
+	while (offset < lazy->length)
+	{
+		if (lazy_is_space(raw[offset]))
+		{
+			offset++;
+			continue;
+		}
+		if (raw[offset] != '/')
+		{
+			break;
+		}
+		if (!(lazy->settings & JSON_ALLOW_COMMENTS))
+		{
+			return lazy_fail(lazy, offset, JSON_ERROR_COMMENTS_DISABLED);
+		}
+
+		size_t start = offset;
+		if (offset + 1 < lazy->length && raw[offset + 1] == '/')
+		{
+			const char* newline = memchr(raw + offset, '\n', lazy->length - offset);
+			offset = newline != NULL ? (size_t)(newline - raw) + 1 : lazy->length;
+		}
+		else if (offset + 1 < lazy->length && raw[offset + 1] == '*')
+		{
+			for (offset += 2; offset + 1 < lazy->length && !(raw[offset] == '*' && raw[offset + 1] == '/'); offset++);
+			if (offset + 1 >= lazy->length)
+			{
+				return lazy_fail(lazy, start, JSON_ERROR_UNEXPECTED_TOKEN);
+			}
+			offset += 2;
+		}
+		else
+		{
+			return lazy_fail(lazy, start, JSON_ERROR_UNEXPECTED_TOKEN);
+		}
+	}
+	return offset;
+}
+
+/* offset right after the string starting at offset, found from its closing quote without decoding it */
+static size_t lazy_string_end(lazy_t* lazy, size_t offset)
+{
+	const char* raw = lazy->raw;
+	for (size_t curr = offset + 1; curr < lazy->length;)
+	{
+		const char* quote = memchr(raw + curr, '"', lazy->length - curr);
+		if (quote == NULL)
+		{
+			break;
+		}
+		/* escaped when it follows an odd run of backslashes */
+		const char* backslash = quote;
+		for (; backslash > raw + offset + 1 && backslash[-1] == '\\'; backslash--);
+		curr = (size_t)(quote - raw) + 1;
+		if ((quote - backslash) % 2 == 0)
+		{
+			return curr;
+		}
+	}
+	return lazy_fail(lazy, lazy->length, JSON_ERROR_UNEXPECTED_TOKEN);
+}
+
+/*	offset right after the container starting at offset. Brackets are matched with the structural index, which leaves
+	out those inside strings, a window at a time. Windows start at one block since most containers are small */
+static size_t lazy_container_end_indexed(lazy_t* lazy, size_t offset)
+{
+	if (lazy->positions == NULL)
+	{
+		lazy->positions = malloc(sizeof * lazy->positions * SCAN_POSITIONS_SIZE(LAZY_WINDOW));
+		if (lazy->positions == NULL)
+		{
+			return lazy_fail(lazy, offset, JSON_ERROR_SYSTEM);
+		}
+	}
+
+	scan_structural_state_t state = { 0 };
+	int depth = 0;
+	for (size_t window = offset, size = 64; window < lazy->length; window += size, size = size < LAZY_WINDOW ? size * 2 : size)
+	{
+		const char* base = lazy->raw + window;
+		size_t count = scan_structurals(&state, base, lazy->length - window < size ? lazy->length - window : size, lazy->positions);
+		for (size_t i = 0; i < count; i++)
+		{
+			switch (base[lazy->positions[i]])
+			{
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0)
+				{
+					return window + lazy->positions[i] + 1;
+				}
+				break;
+			}
+		}
+	}
+	return lazy_fail(lazy, lazy->length, JSON_ERROR_UNEXPECTED_TOKEN);
+}
+
+/* same as lazy_container_end_indexed a byte at a time, for documents with comments, which can hide brackets from the index */
+static size_t lazy_container_end_bytes(lazy_t* lazy, size_t offset)
+{
+	int depth = 0;
+	for (size_t curr = offset; curr < lazy->length && curr != LAZY_NONE;)
+	{
+		switch (lazy->raw[curr])
+		{
+		case '"':
+			curr = lazy_string_end(lazy, curr);
+			break;
+		case '/':
+			curr = lazy_skip_space(lazy, curr);
+			break;
+		case '{':
+		case '[':
+			depth++;
+			curr++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0)
+			{
+				return curr + 1;
+			}
+			curr++;
+			break;
+		default:
+			curr++;
+			break;
+		}
+	}
+	return lazy_fail(lazy, lazy->length, JSON_ERROR_UNEXPECTED_TOKEN);
+}
+
+/* offset right after the value starting at offset */
+static size_t lazy_value_end(lazy_t* lazy, size_t offset)
+{
+	if (lazy->error != JSON_ERROR_NONE || offset >= lazy->length)
+	{
+		return LAZY_NONE;
+	}
+	switch (lazy->raw[offset])
+	{
+	case '"':
+		return lazy_string_end(lazy, offset);
+	case '{':
+	case '[':
+		return lazy->settings & JSON_ALLOW_COMMENTS ? lazy_container_end_bytes(lazy, offset) : lazy_container_end_indexed(lazy, offset);
+	default:
+	{
+		size_t end = offset;
+		for (; end < lazy->length && !lazy_is_atom_end(lazy->raw[end]); end++);
+		return end > offset ? end : lazy_fail(lazy, offset, JSON_ERROR_EXPECTED_VALUE);
+	}
+	}
+}
+
+/* the value starting after whitespace at offset */
+static size_t lazy_value_at(lazy_t* lazy, size_t offset)
+{
+	offset = lazy_skip_space(lazy, offset);
+	if (offset == LAZY_NONE)
+	{
+		return LAZY_NONE;
+	}
+	if (offset >= lazy->length || lazy_is_atom_end(lazy->raw[offset]))
+	{
+		return lazy_fail(lazy, offset, JSON_ERROR_EXPECTED_VALUE);
+	}
+	return offset;
+}
+
+lazy_t lazy_open(const char* raw, size_t length, json_settings_t settings)
+{
+	lazy_t lazy = { .raw = raw, .length = length, .settings = settings & ~JSON_IN_SITU };
+	lazy.root = lazy_value_at(&lazy, 0);
+	return lazy;
+}
+
+void lazy_close(lazy_t* lazy)
+{
+	free(lazy->positions);
+	lazy->positions = NULL;
+}
+
+value_type_t lazy_type(const lazy_t* lazy, size_t index)
+{
+	switch (lazy_byte(lazy, index))
+	{
+	case '{':
+		return TYPE_OBJECT;
+	case '[':
+		return TYPE_ARRAY;
+	case '"':
+		return TYPE_STRING;
+	case 't':
+	case 'f':
+		return TYPE_BOOLEAN;
+	case '-':
+	case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+		return TYPE_NUMBER;
+	default:
+		return TYPE_NULL;
+	}
+}
+
+size_t lazy_child(lazy_t* lazy, size_t index)
+{
+	char open = lazy_byte(lazy, index);
+	if (lazy->error != JSON_ERROR_NONE || (open != '{' && open != '['))
+	{
+		return LAZY_NONE;
+	}
+	size_t first = lazy_skip_space(lazy, index + 1);
+	if (first == LAZY_NONE || (first < lazy->length && lazy->raw[first] == (open == '{' ? '}' : ']')))
+	{
+		return LAZY_NONE;
+	}
+	if (open == '{' && (first >= lazy->length || lazy->raw[first] != '"'))
+	{
+		return lazy_fail(lazy, first, JSON_ERROR_UNEXPECTED_TOKEN);
+	}
+	return lazy_value_at(lazy, first);
+}
+
+size_t lazy_next(lazy_t* lazy, size_t index)
+{
+	if (index == lazy->root || index >= lazy->length)
+	{
+		return LAZY_NONE;
+	}
+	size_t next = lazy_value_end(lazy, index);
+	next = next != LAZY_NONE ? lazy_skip_space(lazy, next) : LAZY_NONE;
+	if (next == LAZY_NONE)
+	{
+		return LAZY_NONE;
+	}
+	if (next >= lazy->length)
+	{
+		return lazy_fail(lazy, next, JSON_ERROR_UNEXPECTED_TOKEN);
+	}
+
+	switch (lazy->raw[next])
+	{
+	case ':':
+		return lazy->raw[index] == '"' ? lazy_value_at(lazy, next + 1) : lazy_fail(lazy, next, JSON_ERROR_UNEXPECTED_TOKEN);
+	case ',':
+		return lazy_value_at(lazy, next + 1);
+	case '}':
+	case ']':
+		return LAZY_NONE;
+	default:
+		return lazy_fail(lazy, next, JSON_ERROR_UNEXPECTED_TOKEN);
+	}
+}
+
+/* whether the key at offset, ending right before end, is key */
+static bool lazy_key_equals(lazy_t* lazy, size_t offset, size_t end, const char* key, size_t key_length)
+{
+	const char* begin = lazy->raw + offset + 1;
+	size_t length = end - offset - 2;
+	if (memchr(begin, '\\', length) == NULL)
+	{
+		return length == key_length && memcmp(begin, key, length) == 0;
+	}
+	/* escaped keys are rare enough to be decoded by the parser */
+	json_state_t decoded = json_parse_n(lazy->raw + offset, end - offset, lazy->settings & ~JSON_USE_ARENA);
+	bool equal = decoded.error == JSON_ERROR_NONE && strcmp(decoded.head.data.string, key) == 0;
+	json_destroy_state(&decoded);
+	return equal;
+}
+
+size_t lazy_find(lazy_t* lazy, size_t index, const char* key)
+{
+	if (lazy_byte(lazy, index) != '{')
+	{
+		return LAZY_NONE;
+	}
+	size_t key_length = strlen(key);
+	for (size_t member = lazy_child(lazy, index); member != LAZY_NONE;)
+	{
+		size_t end = lazy_string_end(lazy, member),
+			colon = end != LAZY_NONE ? lazy_skip_space(lazy, end) : LAZY_NONE;
+		if (colon == LAZY_NONE)
+		{
+			return LAZY_NONE;
+		}
+		if (colon >= lazy->length || lazy->raw[colon] != ':')
+		{
+			return lazy_fail(lazy, colon, JSON_ERROR_UNEXPECTED_TOKEN);
+		}
+		size_t value = lazy_value_at(lazy, colon + 1);
+		if (value == LAZY_NONE || lazy_key_equals(lazy, member, end, key, key_length))
+		{
+			return value;
+		}
+		member = lazy_next(lazy, value);
+		if (member != LAZY_NONE && lazy->raw[member] != '"')
+		{
+			return lazy_fail(lazy, member, JSON_ERROR_UNEXPECTED_TOKEN);
+		}
+	}
+	return LAZY_NONE;
+}
+
+size_t lazy_at(lazy_t* lazy, size_t index, size_t i)
+{
+	if (lazy_byte(lazy, index) != '[')
+	{
+		return LAZY_NONE;
+	}
+	size_t element = lazy_child(lazy, index);
+	for (; element != LAZY_NONE && i > 0; element = lazy_next(lazy, element), i--);
+	return element;
+}
+
+json_state_t lazy_get(lazy_t* lazy, size_t index)
+{
+	/* the root is built up to the end of the document, so what follows it is checked too */
+	size_t end = index == lazy->root && lazy->error == JSON_ERROR_NONE ? lazy->length : lazy_value_end(lazy, index);
+	if (end == LAZY_NONE)
+	{
+		json_error_t error = lazy->error != JSON_ERROR_NONE ? lazy->error : JSON_ERROR_EXPECTED_VALUE;
+		return (json_state_t){ .head = { .type = TYPE_NULL }, .error = error, .pos = lazy->pos };
+	}
+	json_state_t doc = json_parse_n(lazy->raw + index, end - index, lazy->settings);
+	if (doc.error != JSON_ERROR_NONE)
+	{
+		doc.pos += (int)index;
+		lazy_fail(lazy, (size_t)doc.pos, doc.error);
+	}
+	return doc;
+}
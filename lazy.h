@@ -0,0 +1,50 @@
+/*
+	lazy.h ~ RL
+	On-demand access to documents, walking their text only as far as asked.
+*/
+
+#pragma once
+
+#include "json.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*	Values are named by the offset of their first byte in raw. Nothing is parsed when a document is opened: walking
+	to a value skips the subtrees before it by matching brackets, without decoding or allocating them, and values
+	are only built when handed to lazy_get. The walk checks the separators it crosses, not what it skips, so a
+	document is only fully validated by lazy_get on its root. Object members are laid out key, value */
+typedef struct lazy
+{
+	const char* raw;
+	size_t length,
+		root; /* offset of the document's value */
+	json_settings_t settings;
+	json_error_t error; /* first error met. After it, nothing more is walked */
+	int pos;
+	uint32_t* positions; /* scratch for indexing skipped containers, allocated when first needed */
+} lazy_t;
+
+/* no value, returned when there is nothing to return or the walk failed. Every function takes it as an index */
+#define LAZY_NONE ((size_t)-1)
+
+/*	opens the length bytes at raw, which must outlive the document, to be parsed with settings as they are walked.
+	Only finds where the root starts. Check error, then close it with lazy_close whether or not it failed */
+lazy_t lazy_open(const char* raw, size_t length, json_settings_t settings);
+/* frees what walking the document allocated. Values built by lazy_get are freed on their own */
+void lazy_close(lazy_t* lazy);
+
+/*	type of the value at index, from its first byte. Numbers are TYPE_NUMBER, lazy_get can still build them as
+	TYPE_INTEGER or TYPE_UINTEGER with JSON_PARSE_INTEGERS. Anything that isn't the start of a value is TYPE_NULL */
+value_type_t lazy_type(const lazy_t* lazy, size_t index);
+/* first element of the container at index (its first key for an object), or LAZY_NONE if it's empty or not a container */
+size_t lazy_child(lazy_t* lazy, size_t index);
+/* the value after the one at index in the same container, or LAZY_NONE if it was the last. Skips what index holds */
+size_t lazy_next(lazy_t* lazy, size_t index);
+/*	value of key in the object at index, or LAZY_NONE if it's missing. Scans the object's keys in order and stops at
+	the first match, where json_parse would keep the last of repeated keys */
+size_t lazy_find(lazy_t* lazy, size_t index, const char* key);
+/* element i of the array at index, or LAZY_NONE if it's shorter or not an array */
+size_t lazy_at(lazy_t* lazy, size_t index, size_t i);
+/*	builds the value at index like json_parse_n would, validating all of it. Free it with json_destroy_state.
+	Error positions are offsets in the whole document. LAZY_NONE builds the document's error, or JSON_ERROR_EXPECTED_VALUE */
+json_state_t lazy_get(lazy_t* lazy, size_t index);
@@ -3,18 +3,234 @@
 */
 
 #include <ctype.h>
+#include "file.h"
 #include "json.h"
 #include <malloc.h>
+#include "pool.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
 #include "util.h"
 
 static hashmap_t program;
 
+/* documents are only ever dropped as a whole, so let them live in an arena. Integers keep large ids exact when printed back */
+static const json_settings_t document_settings = JSON_DEFAULT_SETTINGS | JSON_USE_ARENA | JSON_PARSE_INTEGERS;
+
 static const char* document_directory = "None";
-static char* document_raw;
+static file_view_t document_file;
 static json_state_t document;
 
+/* prints doc's error along with a few bytes of file starting at its position */
+static void document_print_error(const json_state_t* doc, const file_view_t* file, char* out, size_t size)
+{
+	size_t pos = (size_t)doc->pos,
+		context = pos < file->size ? file->size - pos : 0;
+	snprintf(out, size, "Error code: %i, error pos: %i -> \"%.*s\".", doc->error, doc->pos,
+		(int)(context < 10 ? context : 10), file->data + (pos < file->size ? pos : 0));
+}
+
+struct batch_entry
+{
+	char* path;
+	char* error; /* what went wrong, NULL when the file parsed or there was no memory to describe it */
+	bool failed;
+	size_t size;
+	double seconds;
+};
+
+/* files of a b= argument, handed out to workers one at a time so each only holds one document */
+struct batch
+{
+	struct batch_entry* entries;
+	size_t count,
+		reserved,
+		next;
+	mtx_t lock;
+};
+
+static double batch_now(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static char* batch_copy(const char* str)
+{
+	size_t size = strlen(str) + 1;
+	char* copy = malloc(size);
+	if (copy != NULL)
+	{
+		memcpy(copy, str, size);
+	}
+	return copy;
+}
+
+/* adds the length bytes at path, which need no terminator */
+static bool batch_add_n(struct batch* batch, const char* path, size_t length)
+{
+	if (batch->count == batch->reserved)
+	{
+		size_t new_reserved = batch->reserved > 0 ? batch->reserved * 2 : 64;
+		struct batch_entry* new = realloc(batch->entries, sizeof * new * new_reserved);
+		if (new == NULL)
+		{
+			return false;
+		}
+		batch->entries = new;
+		batch->reserved = new_reserved;
+	}
+
+	char* copy = malloc(length + 1);
+	if (copy == NULL)
+	{
+		return false;
+	}
+	memcpy(copy, path, length);
+	copy[length] = '\0';
+	batch->entries[batch->count++] = (struct batch_entry){ .path = copy };
+	return true;
+}
+
+static bool batch_add(void* user, const char* path)
+{
+	return batch_add_n(user, path, strlen(path));
+}
+
+/* adds every path of a list with one per line */
+static bool batch_add_list(struct batch* batch, const file_view_t* list)
+{
+	const char* end = list->data + list->size;
+	for (const char* line = list->data; line < end;)
+	{
+		const char* newline = memchr(line, '\n', (size_t)(end - line));
+		const char* line_end = newline != NULL ? newline : end;
+		size_t length = (size_t)(line_end - line);
+		if (length > 0 && line[length - 1] == '\r')
+		{
+			length--;
+		}
+		if (length > 0 && !batch_add_n(batch, line, length))
+		{
+			return false;
+		}
+		line = line_end + 1;
+	}
+	return true;
+}
+
+static int batch_work(void* user)
+{
+	struct batch* batch = user;
+	for (;;)
+	{
+		mtx_lock(&batch->lock);
+		size_t i = batch->next++;
+		mtx_unlock(&batch->lock);
+		if (i >= batch->count)
+		{
+			return 0;
+		}
+
+		struct batch_entry* entry = &batch->entries[i];
+		double start = batch_now();
+		file_view_t file;
+		if (!file_view_open(entry->path, &file))
+		{
+			entry->failed = true;
+			entry->error = batch_copy("Failed to open file.");
+			continue;
+		}
+		json_state_t doc = json_parse_n(file.data, file.size, document_settings);
+		entry->seconds = batch_now() - start;
+		entry->size = file.size;
+		if (doc.error != JSON_ERROR_NONE)
+		{
+			entry->failed = true;
+			entry->error = malloc(80);
+			if (entry->error != NULL)
+			{
+				document_print_error(&doc, &file, entry->error, 80);
+			}
+		}
+		json_destroy_state(&doc);
+		file_view_close(&file);
+	}
+}
+
+static int batch_compare(const void* a, const void* b)
+{
+	return strcmp(((const struct batch_entry*)a)->path, ((const struct batch_entry*)b)->path);
+}
+
+/* parses every file of a directory or list on all cores, then prints the report w= would write sorted by path */
+static bool batch_run(const char* path)
+{
+	struct batch batch = { 0 };
+	bool result;
+	if (file_is_directory(path))
+	{
+		result = file_list(path, batch_add, &batch);
+	}
+	else
+	{
+		file_view_t list;
+		result = file_view_open(path, &list);
+		if (result)
+		{
+			result = batch_add_list(&batch, &list);
+			file_view_close(&list);
+		}
+	}
+
+	int threads = pool_cores();
+	double start = batch_now();
+	pool_t pool = NULL;
+	if (result && mtx_init(&batch.lock, mtx_plain) == thrd_success)
+	{
+		pool = pool_start(threads, batch_work, &batch);
+		if (pool != NULL)
+		{
+			pool_join(pool);
+		}
+		mtx_destroy(&batch.lock);
+	}
+	double seconds = batch_now() - start;
+
+	if (pool != NULL)
+	{
+		qsort(batch.entries, batch.count, sizeof * batch.entries, batch_compare);
+		size_t bytes = 0,
+			failed = 0;
+		for (size_t i = 0; i < batch.count; i++)
+		{
+			struct batch_entry* entry = &batch.entries[i];
+			const char* report = !entry->failed ? "no error." : entry->error != NULL ? entry->error : "Failed, ran out of memory describing the error.";
+			printf("\"%s\" - %s (%.3f ms)\n", entry->path, report, entry->seconds * 1e3);
+			bytes += entry->size;
+			failed += entry->failed;
+		}
+		printf("%zu files, %zu with errors, %.1f MB in %.3f s on %d threads", batch.count, failed, bytes * 1e-6, seconds, threads);
+		if (batch.count > 0 && seconds > 0)
+		{
+			printf(": %.1f MB/s, %.0f files/s", bytes * 1e-6 / seconds, batch.count / seconds);
+		}
+		printf(".\n");
+	}
+
+	for (size_t i = 0; i < batch.count; i++)
+	{
+		free(batch.entries[i].path);
+		free(batch.entries[i].error);
+	}
+	free(batch.entries);
+	return pool != NULL;
+}
+
 struct argument_result
 {
 	int exit_code;
@@ -45,34 +261,24 @@ static struct argument_result argument_execute(const char* arg)
 			return (struct argument_result) { -1 };
 		}
 		arg++;
-		FILE* f = fopen(arg, "r");
-		if (f == NULL)
+		/* parsed straight from the mapped file, it is never copied or terminated */
+		file_view_t file;
+		if (!file_view_open(arg, &file))
 		{
 			printf("Failed to open file \"%s\".\n", arg);
 			return (struct argument_result) { -1 };
 		}
-		fseek(f, 0, SEEK_END);
-		long size = ftell(f);
-		fseek(f, 0, SEEK_SET);
-		
-		char* raw = calloc((size_t)size + 1, 1);
-		if (raw == NULL)
-		{
-			return (struct argument_result) { 1 };
-		}
-		fread(raw, 1, size, f);
-		fclose(f);
 
-		if (document_raw != NULL)
+		if (document_file.data != NULL)
 		{
-			free(document_raw);
-			json_destroy(document.head);
+			json_destroy_state(&document);
+			file_view_close(&document_file);
 			printf("Unloaded previous document.\n");
 		}
 
 		document_directory = arg;
-		document_raw = raw;
-		document = json_parse(document_raw);
+		document_file = file;
+		document = json_parse_n(document_file.data, document_file.size, document_settings);
 
 		char* err_buf = NULL;
 		if (document.error != JSON_ERROR_NONE)
@@ -83,7 +289,7 @@ static struct argument_result argument_execute(const char* arg)
 				printf("Failed to allocate memory.\n");
 				return (struct argument_result) { -1 };
 			}
-			snprintf(err_buf, 80, "Error code: %i, error pos: %i -> \"%.10s\".", document.error, document.pos, document_raw + document.pos);
+			document_print_error(&document, &document_file, err_buf, 80);
 		}
 		hashmap_set(program, document_directory, (value_t) { .type = TYPE_STRING, .data.string = err_buf });
 
@@ -114,8 +320,9 @@ static struct argument_result argument_execute(const char* arg)
 	}
 
 	case 'p':
+	case 'c':
 	{
-		if (document_raw == NULL)
+		if (document_file.data == NULL)
 		{
 			printf("Document never loaded.\n");
 			return (struct argument_result) { -1 };
@@ -126,14 +333,22 @@ static struct argument_result argument_execute(const char* arg)
 			printf("Warning: Document loaded has an error, results are undefined.\n");
 		}
 
-		json_write_value(stdout, document.head);
+		json_writer_t writer = json_writer_create(stdout, tolower(*arg) == 'c' ? JSON_WRITER_COMPACT : 4);
+		if (writer == NULL || !json_writer_value(writer, document.head))
+		{
+			printf("Failed to print file.\n");
+		}
+		if (writer != NULL)
+		{
+			json_writer_destroy(writer);
+		}
 		printf("\n");
 		break;
 	}
 
 	case 'e':
 	{
-		if (document_raw == NULL)
+		if (document_file.data == NULL)
 		{
 			printf("Document never loaded.\n");
 			return (struct argument_result) { -1 };
@@ -141,7 +356,9 @@ static struct argument_result argument_execute(const char* arg)
 
 		if (document.error != JSON_ERROR_NONE)
 		{
-			printf("Error code: %i, error pos: %i -> \"%.10s\".\n", document.error, document.pos, document_raw + document.pos);
+			char err_buf[80];
+			document_print_error(&document, &document_file, err_buf, sizeof err_buf);
+			printf("%s\n", err_buf);
 		}
 		break;
 	}
@@ -150,6 +367,23 @@ static struct argument_result argument_execute(const char* arg)
 		printf("Directory: %s\n", document_directory);
 		break;
 
+	case 'b':
+	{
+		arg++;
+		if (!*arg)
+		{
+			printf("Abrupt argument ending.\n");
+			return (struct argument_result) { -1 };
+		}
+		arg++;
+		if (!batch_run(arg))
+		{
+			printf("Failed to batch \"%s\".\n", arg);
+			return (struct argument_result) { -1 };
+		}
+		break;
+	}
+
 	default:
 		printf("Unknown argument %c.\n", *arg);
 		return (struct argument_result) { -1 };
@@ -163,10 +397,13 @@ static inline void argument_print_help(void)
 		"h: Prints this -- help. The help screen takes precedence over all other arguments.\n"
 			"\tIn other words, passing this will effectively void all other arguments.\n"
 		"r=\"[directory]\": Read file at [directory]. Quotation marks are not necessary unless if the directory has spaces; but if included, they must be double-quotes.\n"
-			"\tAdditionally, this frees the previous document loaded.\n"
+			"\tAdditionally, this frees the previous document loaded. Files are mapped into memory, pipes (like /dev/stdin) are read whole.\n"
 		"w=\"[directory]\": Appends/writes map of directories loaded thusfar in the application to their parsed documents' errors into directory.\n"
 			"\tPrevious files will not be a subset of any further files. In other words, calling this writes then clears the program's state.\n"
+		"b=\"[directory]\": Reads every file in [directory], or every file listed in it (one per line) if it is a file, on all cores.\n"
+			"\tPrints what w= would write for them, sorted by path, with how long each took and the total throughput.\n"
 		"p: Prints file read.\n"
+		"c: Prints file read without whitespace.\n"
 		"e: Gets error code, if any.\n"
 		"d: Prints directory of currently loaded file.\n"
 		"Note: arguments are case-insensitive and are \"executed\" in order (except for \"h\").\n"
@@ -202,8 +439,9 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	if (document_raw != NULL)
+	if (document_file.data != NULL)
 	{
-		json_destroy(document.head);
+		json_destroy_state(&document);
+		file_view_close(&document_file);
 	}
 }
\ No newline at end of file
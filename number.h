@@ -0,0 +1,60 @@
+/*
+	number.h ~ RL
+	Conversions between decimal text and doubles.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* a number's significant digits and power of ten, as read from its text */
+typedef struct number_decimal
+{
+	uint64_t mantissa;
+	int64_t exponent;
+	bool negative;
+	bool truncated; /* there were more than 19 significant digits, mantissa only holds the first 19 */
+} number_decimal_t;
+
+typedef enum number_status
+{
+	NUMBER_OK,
+	NUMBER_NO_DIGITS, /* nothing but a sign */
+	NUMBER_LEADING_ZERO,
+	NUMBER_MISSING_FRACTION, /* '.' not followed by digits */
+	NUMBER_MISSING_EXPONENT, /* 'e' not followed by digits */
+	NUMBER_NOT_INTEGER, /* only from number_scan_integer, the number is valid so far but needs number_scan */
+	NUMBER_UNSIGNED, /* only from number_scan_integer, the number is an integer past INT64_MAX that fits in a uint64_t */
+	NUMBER_STATUS_COUNT
+} number_status_t;
+
+/*	reads a number per json's grammar starting at raw, accumulating its digits into decimal on the way.
+	end is set to the first byte past the number */
+number_status_t number_scan(const char* raw, number_decimal_t* decimal, const char** end);
+
+/*	reads a number made only of an optional '-' and digits that fits in an int64_t, without touching floating point.
+	Integers past INT64_MAX up to UINT64_MAX go to out_unsigned instead, returning NUMBER_UNSIGNED.
+	Returns NUMBER_NOT_INTEGER for fractions, exponents, -0 and integers out of range, which need number_scan instead */
+number_status_t number_scan_integer(const char* raw, int64_t* out, uint64_t* out_unsigned, const char** end);
+
+/*	rounds mantissa * 10^exponent to the nearest double, ties to even, giving the same bits strtod would.
+	text and length are the number's source, only read in the rare case a truncated decimal can't be rounded otherwise */
+double number_to_double(number_decimal_t decimal, const char* text, size_t length);
+
+/* enough room for any int64_t or uint64_t written by number_write_integer or number_write_unsigned */
+#define NUMBER_INTEGER_SIZE 20
+
+/* writes value's decimal digits to out, without a terminator, and returns how many bytes were written */
+size_t number_write_integer(int64_t value, char* out);
+/* number_write_integer for the uint64_t values number_scan_integer reads past INT64_MAX */
+size_t number_write_unsigned(uint64_t value, char* out);
+
+/* enough room for any double written by number_write_double */
+#define NUMBER_DOUBLE_SIZE 32
+
+/*	writes finite value in as few digits as it takes to read back as the same double (Grisu2, shortest for all but a
+	tiny fraction of values). Whole numbers below 2^53 are written as integers, very large or small values with an
+	exponent. No terminator is written, returns how many bytes were */
+size_t number_write_double(double value, char* out);
@@ -0,0 +1,340 @@
+/*
+	path.c ~ RL
+	JSON Pointers compiled once and evaluated against many documents.
+*/
+
+#include <limits.h>
+#include <malloc.h>
+#include <string.h>
+#include "path.h"
+
+struct path_step
+{
+	const char* key; /* decoded token, NULL for a wildcard */
+	uint32_t hash; /* hashmap_key_hash of key */
+	int index; /* the token read as an array index, -1 if it isn't one */
+};
+
+/* steps and the decoded keys they point to share one allocation */
+struct path
+{
+	int count;
+	struct path_step steps[];
+};
+
+/* the token as an index: digits without a leading zero that fit an int, or -1. "-" is past the end, so never an element */
+static int path_index(const char* token, size_t length)
+{
+	if (length == 0 || (length > 1 && token[0] == '0'))
+	{
+		return -1;
+	}
+	long long index = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		if (token[i] < '0' || token[i] > '9' || (index = index * 10 + token[i] - '0') > INT_MAX)
+		{
+			return -1;
+		}
+	}
+	return (int)index;
+}
+
+path_t path_compile(const char* pointer)
+{
+	if (*pointer != '\0' && *pointer != '/')
+	{
+		return NULL;
+	}
+	int count = 0;
+	for (const char* curr = pointer; *curr; curr++)
+	{
+		count += *curr == '/';
+	}
+	size_t size = strlen(pointer) + 1;
+	path_t path = malloc(sizeof * path + sizeof * path->steps * count + size);
+	if (path == NULL)
+	{
+		return NULL;
+	}
+	path->count = count;
+
+	char* keys = (char*)&path->steps[count];
+	const char* curr = pointer;
+	for (int i = 0; i < count; i++)
+	{
+		curr++; /* the slash */
+		char* key = keys;
+		for (; *curr && *curr != '/'; curr++)
+		{
+			if (*curr == '~')
+			{
+				if (curr[1] != '0' && curr[1] != '1')
+				{
+					free(path);
+					return NULL;
+				}
+				*keys++ = *++curr == '0' ? '~' : '/';
+			}
+			else
+			{
+				*keys++ = *curr;
+			}
+		}
+		*keys++ = '\0';
+
+		size_t length = (size_t)(keys - key - 1);
+		bool wildcard = length == 1 && *key == '*';
+		path->steps[i] = (struct path_step){
+			.key = wildcard ? NULL : key,
+			.hash = wildcard ? 0 : hashmap_key_hash(key),
+			.index = wildcard ? -1 : path_index(key, length)
+		};
+	}
+	return path;
+}
+
+void path_destroy(path_t path)
+{
+	free(path);
+}
+
+int path_length(const path_t path)
+{
+	return path->count;
+}
+
+struct path_search
+{
+	const path_t path;
+	path_visitor visitor;
+	void* user;
+	bool stopped;
+};
+
+/* a wildcard step's members, searched from the step after it */
+struct path_search_members
+{
+	struct path_search* search;
+	int step;
+};
+
+static void path_search_from(struct path_search* search, int step, value_t val);
+
+static void path_search_member(hashmap_t map, void* user, const char* key, value_t val)
+{
+	(void)map;
+	(void)key;
+	struct path_search_members* members = user;
+	if (!members->search->stopped)
+	{
+		path_search_from(members->search, members->step, val);
+	}
+}
+
+static void path_search_from(struct path_search* search, int step, value_t val)
+{
+	if (step == search->path->count)
+	{
+		search->stopped = !search->visitor(search->user, val);
+		return;
+	}
+
+	const struct path_step* curr = &search->path->steps[step];
+	if (val.type == TYPE_OBJECT)
+	{
+		if (curr->key == NULL)
+		{
+			struct path_search_members members = { search, step + 1 };
+			hashmap_iterate(val.data.object, &members, path_search_member);
+		}
+		else
+		{
+			value_t member;
+			if (hashmap_get_hashed(val.data.object, curr->key, curr->hash, &member))
+			{
+				path_search_from(search, step + 1, member);
+			}
+		}
+	}
+	else if (val.type == TYPE_ARRAY)
+	{
+		int count = array_count(val.data.array);
+		if (curr->key == NULL)
+		{
+			for (int i = 0; i < count && !search->stopped; i++)
+			{
+				path_search_from(search, step + 1, array_get(val.data.array, i));
+			}
+		}
+		else if (curr->index >= 0 && curr->index < count)
+		{
+			path_search_from(search, step + 1, array_get(val.data.array, curr->index));
+		}
+	}
+}
+
+bool path_select(const path_t path, value_t val, path_visitor visitor, void* user)
+{
+	struct path_search search = { .path = path, .visitor = visitor, .user = user };
+	path_search_from(&search, 0, val);
+	return !search.stopped;
+}
+
+static bool path_get_first(void* user, value_t val)
+{
+	*(value_t*)user = val;
+	return false;
+}
+
+bool path_get(const path_t path, value_t val, value_t* out)
+{
+	/* a path without wildcards is a straight walk, kept out of the visitor machinery */
+	int step = 0;
+	for (; step < path->count && path->steps[step].key != NULL; step++)
+	{
+		const struct path_step* curr = &path->steps[step];
+		if (val.type == TYPE_OBJECT)
+		{
+			if (!hashmap_get_hashed(val.data.object, curr->key, curr->hash, &val))
+			{
+				return false;
+			}
+		}
+		else if (val.type == TYPE_ARRAY && curr->index >= 0 && curr->index < array_count(val.data.array))
+		{
+			val = array_get(val.data.array, curr->index);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	if (step == path->count)
+	{
+		*out = val;
+		return true;
+	}
+
+	struct path_search search = { .path = path, .visitor = path_get_first, .user = out };
+	path_search_from(&search, step, val);
+	return search.stopped;
+}
+
+/* what path_parse_events knows of each open container on the way to a match */
+struct path_frame
+{
+	int matched; /* steps matched by the container, -1 when it's off the path */
+	int next_index; /* index of an array's next element */
+	bool key_matched; /* whether an object's last key matched the next step */
+};
+
+struct path_filter
+{
+	const path_t path;
+	json_event_handler handler;
+	void* user;
+	struct path_frame* frames;
+	size_t depth,
+		reserved,
+		forwarding; /* depth of the match being handed to handler, 0 when there is none */
+	bool failed;
+};
+
+/* steps matched by a value starting at the current depth */
+static int path_filter_matched(struct path_filter* filter)
+{
+	if (filter->depth == 0)
+	{
+		return 0;
+	}
+	struct path_frame* parent = &filter->frames[filter->depth - 1];
+	if (parent->matched < 0 || parent->matched == filter->path->count)
+	{
+		return -1;
+	}
+	const struct path_step* step = &filter->path->steps[parent->matched];
+	bool match;
+	if (parent->next_index < 0)
+	{
+		match = parent->key_matched;
+	}
+	else
+	{
+		match = step->key == NULL || step->index == parent->next_index;
+		parent->next_index++;
+	}
+	return match ? parent->matched + 1 : -1;
+}
+
+static bool path_filter_handler(void* user, json_event_t event, value_t val)
+{
+	struct path_filter* filter = user;
+	if (filter->forwarding > 0)
+	{
+		filter->forwarding += event == JSON_EVENT_START_OBJECT || event == JSON_EVENT_START_ARRAY;
+		filter->forwarding -= event == JSON_EVENT_END_OBJECT || event == JSON_EVENT_END_ARRAY;
+		return filter->handler(filter->user, event, val);
+	}
+
+	switch (event)
+	{
+	case JSON_EVENT_KEY:
+	{
+		struct path_frame* frame = &filter->frames[filter->depth - 1];
+		if (frame->matched >= 0 && frame->matched < filter->path->count)
+		{
+			const struct path_step* step = &filter->path->steps[frame->matched];
+			frame->key_matched = step->key == NULL || strcmp(val.data.string, step->key) == 0;
+		}
+		return true;
+	}
+
+	case JSON_EVENT_END_OBJECT:
+	case JSON_EVENT_END_ARRAY:
+		filter->depth--;
+		return true;
+
+	case JSON_EVENT_VALUE:
+		return path_filter_matched(filter) != filter->path->count || filter->handler(filter->user, event, val);
+
+	default:
+	{
+		int matched = path_filter_matched(filter);
+		if (matched == filter->path->count)
+		{
+			filter->forwarding = 1;
+			return filter->handler(filter->user, event, val);
+		}
+		if (filter->depth == filter->reserved)
+		{
+			size_t new_reserved = filter->reserved > 0 ? filter->reserved * 2 : 16;
+			struct path_frame* new = realloc(filter->frames, sizeof * new * new_reserved);
+			if (new == NULL)
+			{
+				filter->failed = true;
+				return false;
+			}
+			filter->frames = new;
+			filter->reserved = new_reserved;
+		}
+		filter->frames[filter->depth++] = (struct path_frame){
+			.matched = matched,
+			.next_index = event == JSON_EVENT_START_ARRAY ? 0 : -1
+		};
+		return true;
+	}
+	}
+}
+
+json_state_t path_parse_events(const path_t path, const char* raw, json_settings_t settings, json_event_handler handler, void* user)
+{
+	struct path_filter filter = { .path = path, .handler = handler, .user = user };
+	json_state_t doc = json_parse_events(raw, settings, path_filter_handler, &filter);
+	if (filter.failed)
+	{
+		doc.error = JSON_ERROR_SYSTEM;
+	}
+	free(filter.frames);
+	return doc;
+}
@@ -0,0 +1,31 @@
+/*
+	path.h ~ RL
+	JSON Pointers compiled once and evaluated against many documents.
+*/
+
+#pragma once
+
+#include "json.h"
+
+typedef struct path* path_t;
+
+/* called with each value a path matches. Returning false stops the search */
+typedef bool (*path_visitor)(void* user, value_t val);
+
+/*	compiles a JSON Pointer (RFC 6901) like "/items/0/name", where "" is the whole document and ~0 and ~1 stand for
+	'~' and '/'. A token that is only "*" matches every member of an object or element of an array instead of a key.
+	Keys are hashed here, once, for every lookup the path will do. Returns NULL if pointer is invalid or memory ran out */
+path_t path_compile(const char* pointer);
+/* frees path */
+void path_destroy(path_t path);
+/* how many tokens path has */
+int path_length(const path_t path);
+
+/* copies the first value path matches in val into out. Returns false if there is none */
+bool path_get(const path_t path, value_t val, value_t* out);
+/*	calls visitor with every value path matches in val, elements in order and members in the object's order.
+	Returns false if visitor stopped it */
+bool path_select(const path_t path, value_t val, path_visitor visitor, void* user);
+/*	parses raw like json_parse_events, handing handler only the events of values path matches: one JSON_EVENT_VALUE,
+	or a container's events from its start to its end. Nothing is built, whether it matches or not */
+json_state_t path_parse_events(const path_t path, const char* raw, json_settings_t settings, json_event_handler handler, void* user);
@@ -0,0 +1,74 @@
+/*
+	pool.c ~ RL
+	Worker threads.
+*/
+
+#ifndef _WIN32
+#define _DEFAULT_SOURCE /* sysconf is POSIX */
+#endif
+#include "pool.h"
+#include <malloc.h>
+#include <threads.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct pool
+{
+	int count;
+	thrd_t threads[];
+};
+
+int pool_cores(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int cores = (int)info.dwNumberOfProcessors;
+#else
+	int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return cores > 0 ? cores : 1;
+}
+
+pool_t pool_start(int count, int (*work)(void* user), void* user)
+{
+	if (count <= 0)
+	{
+		count = pool_cores();
+	}
+
+	pool_t pool = malloc(sizeof * pool + sizeof * pool->threads * (size_t)count);
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+
+	pool->count = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (thrd_create(&pool->threads[pool->count], work, user) == thrd_success)
+		{
+			pool->count++;
+		}
+	}
+
+	if (pool->count == 0)
+	{
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void pool_join(pool_t pool)
+{
+	for (int i = 0; i < pool->count; i++)
+	{
+		thrd_join(pool->threads[i], NULL);
+	}
+	free(pool);
+}
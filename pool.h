@@ -0,0 +1,16 @@
+/*
+	pool.h ~ RL
+	Worker threads.
+*/
+
+#pragma once
+
+typedef struct pool* pool_t;
+
+/* how many threads can run at once on this machine */
+int pool_cores(void);
+/*	starts count threads (0 for one per core) that each run work(user) once. Returns NULL when no thread could be started,
+	if only some could the pool runs with those */
+pool_t pool_start(int count, int (*work)(void* user), void* user);
+/* waits for every thread of the pool to return, then frees it */
+void pool_join(pool_t pool);
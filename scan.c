@@ -0,0 +1,449 @@
+/*
+	scan.c ~ RL
+	Vectorized byte scanning kernels used by the parser.
+*/
+
+#include "scan.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SCAN_TARGET_AVX2
+#else
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2,popcnt,bmi")))
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define SCAN_FORCE_INLINE __forceinline
+#else
+#define SCAN_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+/* the vector kernels read whole aligned blocks around the terminator on purpose */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define SCAN_NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+#endif
+#elif defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define SCAN_NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+#endif
+#ifndef SCAN_NO_SANITIZE
+#define SCAN_NO_SANITIZE
+#endif
+
+static inline int scan_ctz(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static inline int scan_ctz64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (int)index;
+#elif defined(_MSC_VER)
+	return (uint32_t)mask != 0 ? scan_ctz((uint32_t)mask) : 32 + scan_ctz((uint32_t)(mask >> 32));
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+static inline int scan_popcount64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(mask);
+#elif defined(_MSC_VER)
+	return (int)(__popcnt((uint32_t)mask) + __popcnt((uint32_t)(mask >> 32)));
+#else
+	return __builtin_popcountll(mask);
+#endif
+}
+
+/* one bit per byte of a 64 byte block */
+struct scan_masks
+{
+	uint64_t quote,
+		backslash,
+		op,
+		whitespace;
+};
+
+enum scan_class
+{
+	SCAN_CLASS_QUOTE = 0x01,
+	SCAN_CLASS_BACKSLASH = 0x02,
+	SCAN_CLASS_OP = 0x04,
+	SCAN_CLASS_WHITESPACE = 0x08
+};
+
+static const unsigned char scan_classes[256] =
+{
+	['"'] = SCAN_CLASS_QUOTE, ['\\'] = SCAN_CLASS_BACKSLASH,
+	['{'] = SCAN_CLASS_OP, ['}'] = SCAN_CLASS_OP, ['['] = SCAN_CLASS_OP, [']'] = SCAN_CLASS_OP, [':'] = SCAN_CLASS_OP, [','] = SCAN_CLASS_OP,
+	[' '] = SCAN_CLASS_WHITESPACE, ['\t'] = SCAN_CLASS_WHITESPACE, ['\n'] = SCAN_CLASS_WHITESPACE, ['\r'] = SCAN_CLASS_WHITESPACE
+};
+
+static inline struct scan_masks scan_classify_scalar(const char* block)
+{
+	struct scan_masks result = { 0 };
+	for (int i = 0; i < 64; i++)
+	{
+		unsigned char class = scan_classes[(unsigned char)block[i]];
+		result.quote |= (uint64_t)(class & SCAN_CLASS_QUOTE) << i;
+		result.backslash |= (uint64_t)((class & SCAN_CLASS_BACKSLASH) >> 1) << i;
+		result.op |= (uint64_t)((class & SCAN_CLASS_OP) >> 2) << i;
+		result.whitespace |= (uint64_t)((class & SCAN_CLASS_WHITESPACE) >> 3) << i;
+	}
+	return result;
+}
+
+/* bytes that end a plain run, indexed by unsigned byte value */
+static const bool scan_string_stops[256] =
+{
+	['\0'] = true, ['\b'] = true, ['\t'] = true, ['\n'] = true, ['\f'] = true, ['\r'] = true, ['"'] = true, ['\\'] = true
+};
+
+static const char* scan_string_scalar(const char* str)
+{
+	while (!scan_string_stops[(unsigned char)*str])
+	{
+		str++;
+	}
+	return str;
+}
+
+#ifdef SCAN_X86
+
+static inline uint32_t scan_string_mask_sse2(__m128i block)
+{
+	__m128i quote = _mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+		backslash = _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')),
+		terminator = _mm_cmpeq_epi8(block, _mm_setzero_si128()),
+		control = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\b')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\f'))),
+				_mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+	return (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), _mm_or_si128(terminator, control)));
+}
+
+SCAN_NO_SANITIZE static const char* scan_string_sse2(const char* str)
+{
+	/* aligned loads never straddle a page, so reading past the terminator is safe */
+	const char* block = (const char*)((uintptr_t)str & ~(uintptr_t)15);
+	uint32_t mask = scan_string_mask_sse2(_mm_load_si128((const __m128i*)block)) >> (str - block);
+	if (mask != 0)
+	{
+		return str + scan_ctz(mask);
+	}
+
+	for (;;)
+	{
+		block += 16;
+		mask = scan_string_mask_sse2(_mm_load_si128((const __m128i*)block));
+		if (mask != 0)
+		{
+			return block + scan_ctz(mask);
+		}
+	}
+}
+
+SCAN_TARGET_AVX2 static inline uint32_t scan_string_mask_avx2(__m256i block)
+{
+	__m256i quote = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')),
+		backslash = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')),
+		terminator = _mm256_cmpeq_epi8(block, _mm256_setzero_si256()),
+		control = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\b')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\f'))),
+				_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'))));
+	return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(quote, backslash), _mm256_or_si256(terminator, control)));
+}
+
+SCAN_TARGET_AVX2 SCAN_NO_SANITIZE static const char* scan_string_avx2(const char* str)
+{
+	const char* block = (const char*)((uintptr_t)str & ~(uintptr_t)31);
+	uint32_t mask = scan_string_mask_avx2(_mm256_load_si256((const __m256i*)block)) >> (str - block);
+	if (mask != 0)
+	{
+		return str + scan_ctz(mask);
+	}
+
+	for (;;)
+	{
+		block += 32;
+		mask = scan_string_mask_avx2(_mm256_load_si256((const __m256i*)block));
+		if (mask != 0)
+		{
+			return block + scan_ctz(mask);
+		}
+	}
+}
+
+/* classifies 16 bytes into the low 16 bits of each mask */
+static inline struct scan_masks scan_classify_16_sse2(__m128i block)
+{
+	/* '[' and ']' are '{' and '}' without bit 0x20 */
+	__m128i folded = _mm_or_si128(block, _mm_set1_epi8(0x20)),
+		op = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+			_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(':')), _mm_cmpeq_epi8(block, _mm_set1_epi8(','))));
+	__m128i whitespace = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+		_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+	return (struct scan_masks){
+		.quote = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('"'))),
+		.backslash = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))),
+		.op = (uint32_t)_mm_movemask_epi8(op),
+		.whitespace = (uint32_t)_mm_movemask_epi8(whitespace)
+	};
+}
+
+static inline struct scan_masks scan_classify_sse2(const char* block)
+{
+	struct scan_masks result = { 0 };
+	for (int i = 0; i < 64; i += 16)
+	{
+		struct scan_masks part = scan_classify_16_sse2(_mm_loadu_si128((const __m128i*)(block + i)));
+		result.quote |= part.quote << i;
+		result.backslash |= part.backslash << i;
+		result.op |= part.op << i;
+		result.whitespace |= part.whitespace << i;
+	}
+	return result;
+}
+
+/* classifies 32 bytes into the low 32 bits of each mask */
+SCAN_TARGET_AVX2 static inline struct scan_masks scan_classify_32_avx2(__m256i block)
+{
+	__m256i folded = _mm256_or_si256(block, _mm256_set1_epi8(0x20)),
+		op = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(','))));
+	__m256i whitespace = _mm256_or_si256(
+		_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+		_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'))));
+	return (struct scan_masks){
+		.quote = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"'))),
+		.backslash = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\'))),
+		.op = (uint32_t)_mm256_movemask_epi8(op),
+		.whitespace = (uint32_t)_mm256_movemask_epi8(whitespace)
+	};
+}
+
+SCAN_TARGET_AVX2 static inline struct scan_masks scan_classify_avx2(const char* block)
+{
+	struct scan_masks low = scan_classify_32_avx2(_mm256_loadu_si256((const __m256i*)block)),
+		high = scan_classify_32_avx2(_mm256_loadu_si256((const __m256i*)(block + 32)));
+	return (struct scan_masks){
+		.quote = low.quote | high.quote << 32,
+		.backslash = low.backslash | high.backslash << 32,
+		.op = low.op | high.op << 32,
+		.whitespace = low.whitespace | high.whitespace << 32
+	};
+}
+
+static bool scan_cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	__cpuid(info, 1);
+	bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6; /* OSXSAVE, and the OS saves xmm/ymm state */
+	__cpuidex(info, 7, 0);
+	return os_saves_ymm && (info[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const char* (*const scan_string_levels[SCAN_LEVEL_COUNT])(const char*) =
+{
+	[SCAN_SCALAR] = scan_string_scalar,
+#ifdef SCAN_X86
+	[SCAN_SSE2] = scan_string_sse2,
+	[SCAN_AVX2] = scan_string_avx2,
+#endif
+};
+
+/* SCAN_LEVEL_COUNT until the first scan or scan_select picks a level */
+static _Atomic scan_level_t scan_level = SCAN_LEVEL_COUNT;
+
+scan_level_t scan_supported(void)
+{
+#ifdef SCAN_X86
+	return scan_cpu_has_avx2() ? SCAN_AVX2 : SCAN_SSE2;
+#else
+	return SCAN_SCALAR;
+#endif
+}
+
+/* the level to dispatch to, picking the widest supported one if nothing has been picked yet */
+static inline scan_level_t scan_current(void)
+{
+	scan_level_t level = atomic_load_explicit(&scan_level, memory_order_acquire);
+	if (level != SCAN_LEVEL_COUNT)
+	{
+		return level;
+	}
+	/* only the first thread to get here stores its pick, the others and any scan_select that came first keep theirs */
+	scan_level_t unpicked = SCAN_LEVEL_COUNT;
+	level = scan_supported();
+	if (!atomic_compare_exchange_strong_explicit(&scan_level, &unpicked, level, memory_order_acq_rel, memory_order_acquire))
+	{
+		level = unpicked;
+	}
+	return level;
+}
+
+scan_level_t scan_selected(void)
+{
+	return scan_current();
+}
+
+void scan_select(scan_level_t level)
+{
+	scan_level_t supported = scan_supported();
+	atomic_store_explicit(&scan_level, level > supported ? supported : level, memory_order_release);
+}
+
+const char* scan_string(const char* str)
+{
+	return scan_string_levels[scan_current()](str);
+}
+
+/* bit i is set when byte i follows an odd run of backslashes, so it is escaped */
+static inline uint64_t scan_escaped(uint64_t backslash, uint64_t* prev_escaped)
+{
+	const uint64_t even_bits = 0x5555555555555555ULL;
+	backslash &= ~*prev_escaped; /* an escaped backslash does not escape what follows it */
+	uint64_t follows_escape = backslash << 1 | *prev_escaped,
+		odd_sequence_starts = backslash & ~even_bits & ~follows_escape,
+		sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+	*prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts; /* carry out of the addition */
+	uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+	return (even_bits ^ invert_mask) & follows_escape;
+}
+
+/* bit i is the parity of bits 0 through i */
+static inline uint64_t scan_prefix_xor(uint64_t bits)
+{
+	bits ^= bits << 1;
+	bits ^= bits << 2;
+	bits ^= bits << 4;
+	bits ^= bits << 8;
+	bits ^= bits << 16;
+	bits ^= bits << 32;
+	return bits;
+}
+
+static inline uint64_t scan_structural_mask(scan_structural_state_t* state, const struct scan_masks* masks)
+{
+	uint64_t quotes = masks->quote & ~scan_escaped(masks->backslash, &state->escaped),
+		in_string = scan_prefix_xor(quotes) ^ state->in_string; /* covers opening quotes, not closing ones */
+	state->in_string = (uint64_t)((int64_t)in_string >> 63);
+
+	uint64_t outside = ~in_string,
+		scalar = outside & ~(masks->op | masks->whitespace | quotes),
+		scalar_starts = scalar & ~(scalar << 1 | state->scalar);
+	state->scalar = scalar >> 63;
+
+	return (masks->op & outside) | (quotes & in_string) | scalar_starts;
+}
+
+/* inlined into one loop per level, so the classifier is inlined too instead of being called through a pointer per block */
+static SCAN_FORCE_INLINE size_t scan_structurals_with(scan_structural_state_t* pstate, const char* raw, size_t length, uint32_t* positions,
+	struct scan_masks (*classify)(const char*))
+{
+	/* local copy, stores to positions could otherwise alias it */
+	scan_structural_state_t state = *pstate;
+	size_t count = 0;
+	for (size_t offset = 0; offset < length; offset += 64)
+	{
+		struct scan_masks masks;
+		if (length - offset >= 64)
+		{
+			masks = classify(raw + offset);
+		}
+		else
+		{
+			/* pad the last block with whitespace, which is never indexed */
+			char tail[64];
+			memset(tail, ' ', sizeof tail);
+			memcpy(tail, raw + offset, length - offset);
+			masks = classify(tail);
+		}
+
+		/*	dense documents have a structural every other byte, so positions are written 8 at a time without branching
+			on each bit. The extra writes land past the real count, which is why positions needs slack */
+		uint64_t structurals = scan_structural_mask(&state, &masks);
+		uint32_t* out = positions + count;
+		count += scan_popcount64(structurals);
+		while (structurals != 0)
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				out[i] = (uint32_t)(offset + scan_ctz64(structurals | 0x8000000000000000ULL));
+				structurals &= structurals - 1;
+			}
+			out += 8;
+		}
+	}
+	*pstate = state;
+	return count;
+}
+
+static size_t scan_structurals_scalar(scan_structural_state_t* state, const char* raw, size_t length, uint32_t* positions)
+{
+	return scan_structurals_with(state, raw, length, positions, scan_classify_scalar);
+}
+
+#ifdef SCAN_X86
+
+static size_t scan_structurals_sse2(scan_structural_state_t* state, const char* raw, size_t length, uint32_t* positions)
+{
+	return scan_structurals_with(state, raw, length, positions, scan_classify_sse2);
+}
+
+SCAN_TARGET_AVX2 static size_t scan_structurals_avx2(scan_structural_state_t* state, const char* raw, size_t length, uint32_t* positions)
+{
+	return scan_structurals_with(state, raw, length, positions, scan_classify_avx2);
+}
+
+#endif
+
+static size_t (*const scan_structurals_levels[SCAN_LEVEL_COUNT])(scan_structural_state_t*, const char*, size_t, uint32_t*) =
+{
+	[SCAN_SCALAR] = scan_structurals_scalar,
+#ifdef SCAN_X86
+	[SCAN_SSE2] = scan_structurals_sse2,
+	[SCAN_AVX2] = scan_structurals_avx2,
+#endif
+};
+
+size_t scan_structurals(scan_structural_state_t* state, const char* raw, size_t length, uint32_t* positions)
+{
+	return scan_structurals_levels[scan_current()](state, raw, length, positions);
+}
@@ -0,0 +1,44 @@
+/*
+	scan.h ~ RL
+	Vectorized byte scanning kernels used by the parser. Picks the widest instruction set the cpu supports at runtime.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum scan_level
+{
+	SCAN_SCALAR,
+	SCAN_SSE2,
+	SCAN_AVX2,
+	SCAN_LEVEL_COUNT
+} scan_level_t;
+
+/*	returns a pointer to the first byte of str that ends a run of plain string characters: '"', '\\', '\0',
+	or one of the control characters json strings must escape (\b, \f, \n, \r, \t).
+	Reads whole aligned blocks, which may go past the terminator but never into another page */
+const char* scan_string(const char* str);
+
+/* what scan_structurals carries from one 64 byte block to the next */
+typedef struct scan_structural_state
+{
+	uint64_t escaped,
+		in_string,
+		scalar;
+} scan_structural_state_t;
+
+/*	indexes raw's structural characters ({}[]:, and opening quotes outside of strings) along with the first byte of every
+	other run of non-whitespace outside of strings (numbers, literals, garbage). Writes their offsets from raw into
+	positions, which needs room for SCAN_POSITIONS_SIZE(length) entries, and returns how many were written.
+	length must be a multiple of 64 unless it is the last call for a document. state starts zeroed */
+#define SCAN_POSITIONS_SIZE(length) ((length) + 64)
+size_t scan_structurals(scan_structural_state_t* state, const char* raw, size_t length, uint32_t* positions);
+
+/* widest level supported by this cpu */
+scan_level_t scan_supported(void);
+/* level scan_string currently dispatches to */
+scan_level_t scan_selected(void);
+/* makes scan_string dispatch to level, clamped to what's supported. Meant for benchmarks and tests */
+void scan_select(scan_level_t level);
@@ -0,0 +1,89 @@
+#ifdef SCAN_TEST
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+
+#define TEST_COUNT 0x7FFF
+
+int main(int argc, char* argv[])
+{
+	static const char stops[] = { '"', '\\', '\b', '\f', '\n', '\r', '\t' };
+	char* buf = malloc(256);
+	assert(buf);
+
+	for (scan_level_t level = SCAN_SCALAR; level <= scan_supported(); level++)
+	{
+		scan_select(level);
+		assert(scan_selected() == level);
+		srand(1);
+		for (int i = 0; i < TEST_COUNT; i++)
+		{
+			/* random start alignment and stop position, stop byte is sometimes the terminator itself */
+			int start = rand() % 64, stop = start + rand() % 160;
+			for (int j = 0; j < 256; j++)
+			{
+				buf[j] = (char)(' ' + rand() % 95);
+				if (buf[j] == '"' || buf[j] == '\\')
+				{
+					buf[j] = 'x';
+				}
+			}
+			buf[stop] = rand() % 8 == 0 ? '\0' : stops[rand() % sizeof stops];
+			buf[255] = '\0';
+			assert(scan_string(buf + start) == buf + stop);
+		}
+
+		/* bytes above 0x7F are plain characters */
+		memset(buf, 0xC3, 255);
+		buf[200] = '"';
+		assert(scan_string(buf + 3) == buf + 200);
+	}
+
+	/* every level indexes the same positions, even with the state carried over differently sized calls */
+	static const char json_bytes[] = "{}[]:,\"\\ \n1tx";
+	char* doc = malloc(4096);
+	uint32_t* expected = malloc(SCAN_POSITIONS_SIZE(4096) * sizeof * expected),
+		* positions = malloc(SCAN_POSITIONS_SIZE(4096) * sizeof * positions);
+	assert(doc && expected && positions);
+	for (int i = 0; i < 2000; i++)
+	{
+		int length = rand() % 4096;
+		for (int j = 0; j < length; j++)
+		{
+			doc[j] = json_bytes[rand() % (sizeof json_bytes - 1)];
+		}
+
+		scan_select(SCAN_SCALAR);
+		scan_structural_state_t state = { 0 };
+		size_t expected_count = scan_structurals(&state, doc, length, expected);
+		for (scan_level_t level = SCAN_SSE2; level <= scan_supported(); level++)
+		{
+			scan_select(level);
+			state = (scan_structural_state_t){ 0 };
+			int split = (rand() % (length / 64 + 1)) * 64;
+			size_t count = scan_structurals(&state, doc, split, positions);
+			size_t rest = scan_structurals(&state, doc + split, length - split, positions + count);
+			for (size_t j = count; j < count + rest; j++)
+			{
+				positions[j] += split;
+			}
+			assert(count + rest == expected_count);
+			assert(memcmp(positions, expected, expected_count * sizeof * positions) == 0);
+		}
+	}
+
+	/* strings and escapes hide what's inside them, runs of scalars are indexed once */
+	const char* simple = "{\"a\\\"]\": [tru, 12 , \"\\\\\"]}";
+	static const uint32_t simple_expected[] = { 0, 1, 7, 9, 10, 13, 15, 18, 20, 24, 25 };
+	scan_structural_state_t state = { 0 };
+	assert(scan_structurals(&state, simple, strlen(simple), positions) == sizeof simple_expected / sizeof * simple_expected);
+	assert(memcmp(positions, simple_expected, sizeof simple_expected) == 0);
+
+	free(doc);
+	free(expected);
+	free(positions);
+	free(buf);
+}
+#endif
@@ -0,0 +1,263 @@
+/*
+	tape.c ~ RL
+	Read-only documents flattened into one array of 64 bit words and one string buffer.
+*/
+
+#include <malloc.h>
+#include <string.h>
+#include "tape.h"
+#include "util.h"
+
+#define TAPE_PAYLOAD_MASK ((UINT64_C(1) << 56) - 1)
+#define TAPE_WORD(tag, payload) ((uint64_t)(unsigned char)(tag) << 56 | (uint64_t)(payload))
+#define TAPE_TAG(word) ((char)((word) >> 56))
+#define TAPE_PAYLOAD(word) ((size_t)((word) & TAPE_PAYLOAD_MASK))
+#define TAPE_IS_END(word) (TAPE_TAG(word) == '}' || TAPE_TAG(word) == ']')
+
+struct tape_builder
+{
+	tape_t tape;
+	size_t words_reserved,
+		strings_reserved;
+	array_t open; /* index of every open container's first word, in data.integer */
+	bool failed;
+};
+
+static bool tape_push(struct tape_builder* builder, uint64_t word)
+{
+	if (builder->tape.count == builder->words_reserved)
+	{
+		size_t new_reserved = builder->words_reserved * 2;
+		uint64_t* new = realloc(builder->tape.words, sizeof * new * new_reserved);
+		if (new == NULL)
+		{
+			return false;
+		}
+		builder->tape.words = new;
+		builder->words_reserved = new_reserved;
+	}
+	builder->tape.words[builder->tape.count++] = word;
+	return true;
+}
+
+/* copies str into the string buffer and returns its offset, or TAPE_NONE on failure */
+static size_t tape_push_string(struct tape_builder* builder, const char* str)
+{
+	size_t size = strlen(str) + 1,
+		offset = builder->tape.strings_size;
+	if (offset + size > builder->strings_reserved)
+	{
+		size_t new_reserved = builder->strings_reserved * 2;
+		for (; offset + size > new_reserved; new_reserved *= 2);
+		char* new = realloc(builder->tape.strings, new_reserved);
+		if (new == NULL)
+		{
+			return TAPE_NONE;
+		}
+		builder->tape.strings = new;
+		builder->strings_reserved = new_reserved;
+	}
+	memcpy(builder->tape.strings + offset, str, size);
+	builder->tape.strings_size += size;
+	return offset;
+}
+
+static bool tape_handler(void* user, json_event_t event, value_t val)
+{
+	struct tape_builder* builder = user;
+	size_t index = builder->tape.count;
+	bool result;
+	switch (event)
+	{
+	case JSON_EVENT_START_OBJECT:
+	case JSON_EVENT_START_ARRAY:
+		result = array_push(builder->open, (value_t) { .type = TYPE_INTEGER, .data.integer = (int64_t)index })
+			&& tape_push(builder, TAPE_WORD(event == JSON_EVENT_START_OBJECT ? '{' : '[', 0));
+		break;
+
+	case JSON_EVENT_END_OBJECT:
+	case JSON_EVENT_END_ARRAY:
+	{
+		size_t start = (size_t)ARRAY_TOP(builder->open).data.integer;
+		array_pop(builder->open);
+		result = tape_push(builder, TAPE_WORD(event == JSON_EVENT_END_OBJECT ? '}' : ']', start));
+		builder->tape.words[start] |= index + 1;
+		break;
+	}
+
+	default:
+		switch (val.type)
+		{
+		case TYPE_STRING:
+		{
+			size_t offset = tape_push_string(builder, val.data.string);
+			result = offset != TAPE_NONE && tape_push(builder, TAPE_WORD('"', offset));
+			break;
+		}
+		case TYPE_NUMBER:
+		{
+			uint64_t bits;
+			memcpy(&bits, &val.data.number, sizeof bits);
+			result = tape_push(builder, TAPE_WORD('d', 0)) && tape_push(builder, bits);
+			break;
+		}
+		case TYPE_INTEGER:
+			result = tape_push(builder, TAPE_WORD('l', 0)) && tape_push(builder, (uint64_t)val.data.integer);
+			break;
+		case TYPE_UINTEGER:
+			result = tape_push(builder, TAPE_WORD('u', 0)) && tape_push(builder, val.data.uinteger);
+			break;
+		case TYPE_BOOLEAN:
+			result = tape_push(builder, TAPE_WORD(val.data.boolean ? 't' : 'f', 0));
+			break;
+		default:
+			result = tape_push(builder, TAPE_WORD('n', 0));
+			break;
+		}
+		break;
+	}
+
+	builder->failed = !result;
+	return result;
+}
+
+tape_t tape_parse(const char* raw, json_settings_t settings)
+{
+	/* a guess at the final sizes from the document's, so small documents don't grow a dozen times */
+	size_t length = strlen(raw);
+	struct tape_builder builder = {
+		.words_reserved = length / 8 + 16,
+		.strings_reserved = length / 4 + 64,
+		.open = array_create()
+	};
+	builder.tape.words = malloc(sizeof * builder.tape.words * builder.words_reserved);
+	builder.tape.strings = malloc(builder.strings_reserved);
+	if (builder.open == NULL || builder.tape.words == NULL || builder.tape.strings == NULL)
+	{
+		builder.tape.error = JSON_ERROR_SYSTEM;
+	}
+	else
+	{
+		json_state_t doc = json_parse_events(raw, settings, tape_handler, &builder);
+		builder.tape.error = builder.failed ? JSON_ERROR_SYSTEM : doc.error;
+		builder.tape.pos = doc.pos;
+	}
+
+	if (builder.open != NULL)
+	{
+		array_destroy(builder.open);
+	}
+	if (builder.tape.error != JSON_ERROR_NONE)
+	{
+		tape_destroy(&builder.tape);
+	}
+	return builder.tape;
+}
+
+void tape_destroy(tape_t* tape)
+{
+	free(tape->words);
+	free(tape->strings);
+	tape->words = NULL;
+	tape->strings = NULL;
+	tape->count = 0;
+	tape->strings_size = 0;
+}
+
+value_type_t tape_type(const tape_t* tape, size_t index)
+{
+	switch (TAPE_TAG(tape->words[index]))
+	{
+	case '{':
+		return TYPE_OBJECT;
+	case '[':
+		return TYPE_ARRAY;
+	case '"':
+		return TYPE_STRING;
+	case 'd':
+		return TYPE_NUMBER;
+	case 'l':
+		return TYPE_INTEGER;
+	case 'u':
+		return TYPE_UINTEGER;
+	case 't':
+	case 'f':
+		return TYPE_BOOLEAN;
+	default:
+		return TYPE_NULL;
+	}
+}
+
+value_t tape_get(const tape_t* tape, size_t index)
+{
+	uint64_t word = tape->words[index];
+	value_t result = { .type = tape_type(tape, index) };
+	switch (result.type)
+	{
+	case TYPE_STRING:
+		result.data.string = tape->strings + TAPE_PAYLOAD(word);
+		break;
+	case TYPE_NUMBER:
+		memcpy(&result.data.number, &tape->words[index + 1], sizeof result.data.number);
+		break;
+	case TYPE_INTEGER:
+		result.data.integer = (int64_t)tape->words[index + 1];
+		break;
+	case TYPE_UINTEGER:
+		result.data.uinteger = tape->words[index + 1];
+		break;
+	case TYPE_BOOLEAN:
+		result.data.boolean = TAPE_TAG(word) == 't';
+		break;
+	default:
+		break;
+	}
+	return result;
+}
+
+size_t tape_child(const tape_t* tape, size_t index)
+{
+	char tag = TAPE_TAG(tape->words[index]);
+	if ((tag != '{' && tag != '[') || TAPE_IS_END(tape->words[index + 1]))
+	{
+		return TAPE_NONE;
+	}
+	return index + 1;
+}
+
+size_t tape_next(const tape_t* tape, size_t index)
+{
+	uint64_t word = tape->words[index];
+	switch (TAPE_TAG(word))
+	{
+	case '{':
+	case '[':
+		index = TAPE_PAYLOAD(word);
+		break;
+	case 'd':
+	case 'l':
+	case 'u':
+		index += 2;
+		break;
+	default:
+		index++;
+		break;
+	}
+	return index < tape->count && !TAPE_IS_END(tape->words[index]) ? index : TAPE_NONE;
+}
+
+size_t tape_find(const tape_t* tape, size_t index, const char* key)
+{
+	if (TAPE_TAG(tape->words[index]) != '{')
+	{
+		return TAPE_NONE;
+	}
+	for (size_t member = tape_child(tape, index); member != TAPE_NONE; member = tape_next(tape, tape_next(tape, member)))
+	{
+		if (strcmp(tape->strings + TAPE_PAYLOAD(tape->words[member]), key) == 0)
+		{
+			return member + 1;
+		}
+	}
+	return TAPE_NONE;
+}
@@ -0,0 +1,46 @@
+/*
+	tape.h ~ RL
+	Read-only documents flattened into one array of 64 bit words and one string buffer.
+*/
+
+#pragma once
+
+#include "json.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*	Every value is one word with its tag in the top byte: '{' '[' '"' 't' 'f' 'n', or 'd', 'l' and 'u' for doubles,
+	integers and unsigned integers, which are followed by a second word holding their bits. Containers end with a '}' or ']' word.
+	The low 56 bits are the index of the word after the matching end for '{' and '[', the index of the opening word
+	for '}' and ']', and the offset of the terminated string in strings for '"'. Object members are laid out key, value */
+typedef struct tape
+{
+	uint64_t* words;
+	size_t count; /* words used */
+	char* strings;
+	size_t strings_size;
+	json_error_t error;
+	int pos;
+} tape_t;
+
+/* no value, returned by tape_child, tape_next and tape_find when there is nothing to return */
+#define TAPE_NONE ((size_t)-1)
+/* index of the document's root value */
+#define TAPE_ROOT 0
+
+/* parses raw given settings into a tape. Check error before using it, then free it with tape_destroy */
+tape_t tape_parse(const char* raw, json_settings_t settings);
+/* frees the tape's words and strings */
+void tape_destroy(tape_t* tape);
+
+/* type of the value at index */
+value_type_t tape_type(const tape_t* tape, size_t index);
+/*	value at index. Strings point into the tape's buffer, containers have no data.
+	Use tape_child to go into containers */
+value_t tape_get(const tape_t* tape, size_t index);
+/* first element of the container at index (its first key for an object), or TAPE_NONE if it's empty or not a container */
+size_t tape_child(const tape_t* tape, size_t index);
+/* the value after the one at index in the same container, or TAPE_NONE if it was the last. Skips containers in O(1) */
+size_t tape_next(const tape_t* tape, size_t index);
+/* value of key in the object at index, or TAPE_NONE if it's missing. Scans the object's keys in order */
+size_t tape_find(const tape_t* tape, size_t index, const char* key);
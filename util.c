@@ -9,44 +9,334 @@
 #include <stdint.h>
 #include <string.h>
 
-#define START_RESERVE 64
+#define START_RESERVE 4
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct arena_block
+{
+	struct arena_block* prev;
+	size_t size;
+};
+
+struct arena
+{
+	struct arena_block* head;
+	char* top,
+		* end,
+		* last;
+	size_t block_size;
+	const allocator_t* blocks; /* where the arena and its blocks come from */
+	allocator_t allocator; /* hands out memory from the arena, for its containers */
+};
+
+#define ARENA_BLOCK_DATA(block) ((char*)(block) + ARENA_ALIGN(sizeof(struct arena_block)))
+
+double value_to_number(value_t val)
+{
+	switch (val.type)
+	{
+	case TYPE_INTEGER:
+		return (double)val.data.integer;
+	case TYPE_UINTEGER:
+		return (double)val.data.uinteger;
+	default:
+		return val.data.number;
+	}
+}
+
+void* allocator_alloc(const allocator_t* allocator, size_t size, alloc_kind_t kind)
+{
+	return allocator != NULL ? allocator->alloc(allocator->user, size, kind) : malloc(size);
+}
+
+void* allocator_realloc(const allocator_t* allocator, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind)
+{
+	return allocator != NULL ? allocator->realloc(allocator->user, ptr, old_size, new_size, kind) : realloc(ptr, new_size);
+}
+
+void allocator_free(const allocator_t* allocator, void* ptr, alloc_kind_t kind)
+{
+	if (ptr == NULL)
+	{
+		return;
+	}
+	if (allocator != NULL)
+	{
+		allocator->free(allocator->user, ptr, kind);
+		return;
+	}
+	free(ptr);
+}
+
+/* the size of a counted allocation sits right before it, in a header that keeps it aligned like malloc's */
+#define COUNTING_HEADER_SIZE ARENA_ALIGN(sizeof(size_t))
+
+static void counting_add(alloc_counts_t* counts, alloc_kind_t kind, size_t removed, size_t added)
+{
+	counts->bytes[kind] += added - removed;
+	size_t held = alloc_counts_bytes(counts);
+	if (held > counts->peak)
+	{
+		counts->peak = held;
+	}
+}
+
+static void* counting_realloc(void* user, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind)
+{
+	(void)old_size; /* the header has it */
+	alloc_counts_t* counts = user;
+	char* block = ptr != NULL ? (char*)ptr - COUNTING_HEADER_SIZE : NULL;
+	size_t held = 0;
+	if (block != NULL)
+	{
+		memcpy(&held, block, sizeof held);
+	}
+
+	block = realloc(block, COUNTING_HEADER_SIZE + new_size);
+	if (block == NULL)
+	{
+		return NULL;
+	}
+	memcpy(block, &new_size, sizeof new_size);
+	counts->calls[kind]++;
+	counting_add(counts, kind, held, new_size);
+	return block + COUNTING_HEADER_SIZE;
+}
+
+static void* counting_alloc(void* user, size_t size, alloc_kind_t kind)
+{
+	return counting_realloc(user, NULL, 0, size, kind);
+}
+
+static void counting_free(void* user, void* ptr, alloc_kind_t kind)
+{
+	alloc_counts_t* counts = user;
+	char* block = (char*)ptr - COUNTING_HEADER_SIZE;
+	size_t held;
+	memcpy(&held, block, sizeof held);
+	counts->frees[kind]++;
+	counting_add(counts, kind, held, 0);
+	free(block);
+}
+
+allocator_t allocator_counting(alloc_counts_t* counts)
+{
+	return (allocator_t){ .alloc = counting_alloc, .realloc = counting_realloc, .free = counting_free, .user = counts };
+}
+
+size_t alloc_counts_bytes(const alloc_counts_t* counts)
+{
+	size_t total = 0;
+	for (int i = 0; i < ALLOC_KIND_COUNT; i++)
+	{
+		total += counts->bytes[i];
+	}
+	return total;
+}
+
+static void* arena_allocator_alloc(void* user, size_t size, alloc_kind_t kind)
+{
+	(void)kind;
+	return arena_alloc(user, size);
+}
+
+static void* arena_allocator_realloc(void* user, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind)
+{
+	(void)kind;
+	return arena_realloc(user, ptr, old_size, new_size);
+}
+
+static void arena_allocator_free(void* user, void* ptr, alloc_kind_t kind)
+{
+	/* arenas only give memory back all at once */
+	(void)user;
+	(void)ptr;
+	(void)kind;
+}
+
+arena_t arena_create_with(size_t block_size, const allocator_t* blocks)
+{
+	arena_t result = allocator_alloc(blocks, sizeof * result, ALLOC_ARENA);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+
+	*result = (struct arena){
+		.block_size = block_size > 0 ? ARENA_ALIGN(block_size) : ARENA_BLOCK_SIZE,
+		.blocks = blocks,
+		.allocator = { .alloc = arena_allocator_alloc, .realloc = arena_allocator_realloc, .free = arena_allocator_free, .user = result }
+	};
+	return result;
+}
+
+arena_t arena_create(size_t block_size)
+{
+	return arena_create_with(block_size, NULL);
+}
+
+void arena_destroy(arena_t arena)
+{
+	struct arena_block* block = arena->head;
+	while (block != NULL)
+	{
+		struct arena_block* prev = block->prev;
+		allocator_free(arena->blocks, block, ALLOC_ARENA);
+		block = prev;
+	}
+	allocator_free(arena->blocks, arena, ALLOC_ARENA);
+}
+
+void arena_reset(arena_t arena)
+{
+	if (arena->head == NULL)
+	{
+		return;
+	}
+
+	struct arena_block* block = arena->head->prev;
+	while (block != NULL)
+	{
+		struct arena_block* prev = block->prev;
+		allocator_free(arena->blocks, block, ALLOC_ARENA);
+		block = prev;
+	}
+	arena->head->prev = NULL;
+	arena->top = arena->last = ARENA_BLOCK_DATA(arena->head);
+}
+
+static void* arena_alloc_block(arena_t arena, size_t size)
+{
+	/*	requests bigger than a quarter block get a block of their own, which is chained behind the current one
+		so the rest of the current block is still used */
+	bool oversized = size > arena->block_size / 4;
+	size_t data_size = oversized ? size : arena->block_size;
+	struct arena_block* block = allocator_alloc(arena->blocks, ARENA_ALIGN(sizeof * block) + data_size, ALLOC_ARENA);
+	if (block == NULL)
+	{
+		return NULL;
+	}
+	block->size = data_size;
+
+	if (oversized && arena->head != NULL)
+	{
+		block->prev = arena->head->prev;
+		arena->head->prev = block;
+		return ARENA_BLOCK_DATA(block);
+	}
+
+	block->prev = arena->head;
+	arena->head = block;
+	arena->top = ARENA_BLOCK_DATA(block) + size;
+	arena->end = ARENA_BLOCK_DATA(block) + data_size;
+	arena->last = ARENA_BLOCK_DATA(block);
+	return arena->last;
+}
+
+void* arena_alloc(arena_t arena, size_t size)
+{
+	size = ARENA_ALIGN(size);
+	if ((size_t)(arena->end - arena->top) < size)
+	{
+		return arena_alloc_block(arena, size);
+	}
+
+	arena->last = arena->top;
+	arena->top += size;
+	return arena->last;
+}
+
+void* arena_realloc(arena_t arena, void* ptr, size_t old_size, size_t new_size)
+{
+	if (ptr == NULL)
+	{
+		return arena_alloc(arena, new_size);
+	}
+
+	if (ptr == arena->last && (size_t)(arena->end - arena->last) >= ARENA_ALIGN(new_size))
+	{
+		arena->top = arena->last + ARENA_ALIGN(new_size);
+		return ptr;
+	}
+
+	if (new_size <= old_size)
+	{
+		return ptr;
+	}
+
+	void* result = arena_alloc(arena, new_size);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+	memcpy(result, ptr, old_size);
+	return result;
+}
+
+const allocator_t* arena_allocator(arena_t arena)
+{
+	return &arena->allocator;
+}
 
 struct array
 {
 	int count,
 		reserved;
 	value_t* data;
+	const allocator_t* allocator; /* NULL for malloc */
 };
 
-array_t array_create(void)
+/* storage is only allocated once there is something to store, arrays that stay empty only cost the struct */
+array_t array_create_with(const allocator_t* allocator, int reserved)
 {
-	array_t result = malloc(sizeof * result);
+	array_t result = allocator_alloc(allocator, sizeof * result, ALLOC_ARRAY);
 	if (result == NULL)
 	{
 		return NULL;
 	}
 
-	result->count = 0;
-	result->reserved = START_RESERVE;
-	result->data = malloc(sizeof * result->data * result->reserved);
-	if (result->data == NULL)
+	*result = (struct array){ .reserved = reserved, .allocator = allocator };
+	if (reserved > 0)
 	{
-		return NULL;
+		result->data = allocator_alloc(allocator, sizeof * result->data * reserved, ALLOC_ARRAY);
+		if (result->data == NULL)
+		{
+			allocator_free(allocator, result, ALLOC_ARRAY);
+			return NULL;
+		}
 	}
-
 	return result;
 }
 
+array_t array_create_sized_in(arena_t arena, int reserved)
+{
+	return array_create_with(arena != NULL ? arena_allocator(arena) : NULL, reserved);
+}
+
+array_t array_create_in(arena_t arena)
+{
+	return array_create_sized_in(arena, 0);
+}
+
+array_t array_create(void)
+{
+	return array_create_in(NULL);
+}
+
 void array_destroy(array_t array)
 {
-	free(array->data);
-	free(array);
+	allocator_free(array->allocator, array->data, ALLOC_ARRAY);
+	allocator_free(array->allocator, array, ALLOC_ARRAY);
 }
 
-static inline bool array_reserve(array_t array, int addend)
+/* doubles the array's storage, or gives it START_RESERVE values if it has none */
+static inline bool array_reserve(array_t array)
 {
-	int new_count = array->reserved + addend;
-	value_t* new_array = realloc(array->data, sizeof * new_array * new_count);
+	int new_count = array->reserved > 0 ? array->reserved * 2 : START_RESERVE;
+	value_t* new_array = allocator_realloc(array->allocator, array->data, sizeof * new_array * array->reserved, sizeof * new_array * new_count, ALLOC_ARRAY);
 	if (new_array == NULL)
 	{
 		return false;
@@ -58,15 +348,11 @@ static inline bool array_reserve(array_t array, int addend)
 
 bool array_push(array_t array, value_t val)
 {
-	array->data[array->count] = val;
-	array->count++;
-	if (array->reserved <= array->count)
+	if (array->count == array->reserved && !array_reserve(array))
 	{
-		if (!array_reserve(array, array->reserved))
-		{
-			return false;
-		}
+		return false;
 	}
+	array->data[array->count++] = val;
 	return true;
 }
 
@@ -80,16 +366,13 @@ void array_pop(array_t array)
 
 bool array_add(array_t array, int i, value_t val)
 {
-	array->count++;
-	if (array->reserved <= array->count)
+	if (array->count == array->reserved && !array_reserve(array))
 	{
-		if (!array_reserve(array, array->reserved))
-		{
-			return false;
-		}
+		return false;
 	}
+	array->count++;
 	assert(i >= 0 && i < array->count);
-	memmove(array->data + i + 1, array->data + i, (array->count - i) * sizeof * array->data);
+	memmove(array->data + i + 1, array->data + i, (array->count - i - 1) * sizeof * array->data);
 	array->data[i] = val;
 	return true;
 }
@@ -106,6 +389,12 @@ void array_clear(array_t array)
 	array->count = 0;
 }
 
+void array_truncate(array_t array, int count)
+{
+	assert(count >= 0 && count <= array->count);
+	array->count = count;
+}
+
 value_t array_get(array_t array, int i)
 {
 	assert(i >= 0 && i < array->count);
@@ -123,157 +412,389 @@ const value_t* array_data(array_t array)
 	return array->data;
 }
 
-/* This hashmap implementation doesn't use buckets for the sake of simplicity; it instead uses the hash a starting index. This is likely less performant. */
-#define EXISTS(map, hash) (hashmap_find((map), (hash)) < (map)->reserved)
+/*	Small maps keep their pairs in a plain vector in insertion order and search it linearly. Past HASHMAP_INLINE_MAX
+	entries the map becomes a Robin Hood open addressing table: a key sits at most as far from its home slot as any key it
+	passed while probing, so lookups stop as soon as they reach a slot closer to home than they are. Removal shifts the
+	following run back one slot instead of leaving tombstones. */
+#define HASHMAP_INLINE_START 4
+#define HASHMAP_INLINE_MAX 8
+#define HASHMAP_START_RESERVE 16
+#define HASHMAP_MAX_LOAD(reserved) ((reserved) - (reserved) / 8) /* 7/8 */
+#define HASHMAP_IS_INLINE(map) ((map)->reserved <= HASHMAP_INLINE_MAX)
 #define NOT_FOUND -1
-typedef uintmax_t hash_t;
+typedef uint32_t hash_t;
 
 struct key_value_pair
 {
 	const char* key;
 	hash_t key_hash;
+	uint32_t distance; /* 1 + slots from the key's home slot, 0 if the slot is empty */
+	value_t value;
+};
+
+struct inline_pair
+{
+	const char* key;
 	value_t value;
 };
 
 struct hashmap
 {
 	int cache_count,
-		reserved;
+		reserved; /* pairs while inline, otherwise slots, always a power of two past HASHMAP_INLINE_MAX */
 	const char* curr_key;
-	struct key_value_pair* data;
+	union
+	{
+		struct inline_pair* pairs;
+		struct key_value_pair* data;
+	};
+	const allocator_t* allocator; /* NULL for malloc */
+#ifdef JSON_STATS
+	int resizes;
+#endif
 };
 
-hashmap_t hashmap_create(void)
+static inline struct key_value_pair* hashmap_alloc_pairs(const allocator_t* allocator, int count)
+{
+	if (allocator == NULL)
+	{
+		return calloc(count, sizeof(struct key_value_pair));
+	}
+
+	struct key_value_pair* result = allocator_alloc(allocator, count * sizeof * result, ALLOC_OBJECT);
+	if (result != NULL)
+	{
+		memset(result, 0, count * sizeof * result);
+	}
+	return result;
+}
+
+/* count entries fit inline up to HASHMAP_INLINE_MAX, past it in the smallest table that keeps them under the load limit */
+hashmap_t hashmap_create_with(const allocator_t* allocator, int count)
 {
-	hashmap_t result = malloc(sizeof * result);
+	/* maps start inline with no storage at all, so empty objects only cost the struct */
+	hashmap_t result = allocator_alloc(allocator, sizeof * result, ALLOC_OBJECT);
 	if (result == NULL)
 	{
 		return NULL;
 	}
+	*result = (struct hashmap){ .allocator = allocator };
+	if (count == 0)
+	{
+		return result;
+	}
 
-	result->curr_key = NULL;
-	result->cache_count = 0;
-	result->reserved = START_RESERVE;
-	result->data = calloc(result->reserved, sizeof * result->data);
+	if (count <= HASHMAP_INLINE_MAX)
+	{
+		result->pairs = allocator_alloc(allocator, sizeof * result->pairs * count, ALLOC_OBJECT);
+		result->reserved = count;
+	}
+	else
+	{
+		for (result->reserved = HASHMAP_START_RESERVE; HASHMAP_MAX_LOAD(result->reserved) < count; result->reserved *= 2);
+		result->data = hashmap_alloc_pairs(allocator, result->reserved);
+	}
 	if (result->data == NULL)
 	{
+		allocator_free(allocator, result, ALLOC_OBJECT);
 		return NULL;
 	}
 	return result;
 }
 
+hashmap_t hashmap_create_in(arena_t arena)
+{
+	return hashmap_create_sized_in(arena, 0);
+}
+
+hashmap_t hashmap_create_sized_in(arena_t arena, int count)
+{
+	return hashmap_create_with(arena != NULL ? arena_allocator(arena) : NULL, count);
+}
+
+hashmap_t hashmap_create(void)
+{
+	return hashmap_create_in(NULL);
+}
+
 void hashmap_destroy(hashmap_t map)
 {
-	free(map->data);
-	free(map);
+	allocator_free(map->allocator, map->data, ALLOC_OBJECT);
+	allocator_free(map->allocator, map, ALLOC_OBJECT);
 }
 
-static inline bool hashmap_reserve(hashmap_t map, int addend)
+/* multiplies in 8 bytes at a time, then folds the 64 bit state down with murmur3's finalizer */
+static inline hash_t hashmap_hash(const char* key, size_t length)
 {
-	int new_count = map->reserved + addend;
-	struct key_value_pair* new = calloc(new_count, sizeof * map->data);
-	if (new == NULL)
+	const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+	uint64_t hash = length * multiplier, word;
+	for (; length >= 8; key += 8, length -= 8)
 	{
-		return false;
+		memcpy(&word, key, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 29;
 	}
-	struct hashmap prev = *map;
-	*map = (struct hashmap){ .data = new, .reserved = new_count, .cache_count = 0 };
-	for (int i = 0; i < prev.reserved; i++)
+	if (length > 0)
 	{
-		if (prev.data[i].key_hash != 0 &&
-			!hashmap_set(map, prev.data[i].key, prev.data[i].value))
+		word = 0;
+		for (size_t i = 0; i < length; i++)
 		{
-			*map = prev;
-			return false;
+			word |= (uint64_t)(unsigned char)key[i] << (i * 8);
 		}
+		hash = (hash ^ word) * multiplier;
 	}
-	free(prev.data);
-	return true;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return (hash_t)hash;
 }
 
-static inline int hashmap_find(hashmap_t map, hash_t hash)
+/* index of key's pair in an inline map, or NOT_FOUND */
+static inline int hashmap_find_inline(const hashmap_t map, const char* key)
 {
-	int i;
-	for (i = hash % map->reserved; i < map->reserved && map->data[i].key_hash != hash; i++);
-	return i;
+	for (int i = 0; i < map->cache_count; i++)
+	{
+		const char* pair_key = map->pairs[i].key;
+		if (pair_key == key || (pair_key[0] == key[0] && strcmp(pair_key, key) == 0)) /* interned keys are the same pointer */
+		{
+			return i;
+		}
+	}
+	return NOT_FOUND;
 }
 
-static inline int hashmap_next_free(hashmap_t map, hash_t hash)
+/* index of key's entry in a table, or NOT_FOUND */
+static inline int hashmap_find_table(const hashmap_t map, const char* key, hash_t hash)
 {
-	int i;
-	for (i = hash % map->reserved; i < map->reserved && map->data[i].key_hash != 0; i++);
-	if (i >= map->reserved)
+	int mask = map->reserved - 1;
+	for (uint32_t i = hash & mask, distance = 1;; i = (i + 1) & mask, distance++)
 	{
-		if (hashmap_reserve(map, map->reserved))
+		struct key_value_pair* pair = &map->data[i];
+		if (pair->distance < distance)
 		{
-			return hashmap_next_free(map, hash);
+			return NOT_FOUND;
 		}
+		if (pair->key_hash == hash && (pair->key == key || strcmp(pair->key, key) == 0))
+		{
+			return (int)i;
+		}
+	}
+}
 
-		i = NOT_FOUND;
+/* pointer to key's value, or NULL. Inline maps never need the hash, so it is only computed when there's a table */
+static inline value_t* hashmap_find(const hashmap_t map, const char* key, const hash_t* hash)
+{
+	if (HASHMAP_IS_INLINE(map))
+	{
+		int i = hashmap_find_inline(map, key);
+		return i != NOT_FOUND ? &map->pairs[i].value : NULL;
 	}
-	return i;
+	int i = hashmap_find_table(map, key, hash != NULL ? *hash : hashmap_hash(key, strlen(key)));
+	return i != NOT_FOUND ? &map->data[i].value : NULL;
 }
 
-static inline hash_t hashmap_djb3(const char* key)
+/* places a key that isn't in the table, swapping it with every richer entry it passes. There must be a free slot */
+static inline void hashmap_place(hashmap_t map, struct key_value_pair pair)
 {
-	hash_t hash = 5381;
-	do
+	int mask = map->reserved - 1;
+	pair.distance = 1;
+	for (uint32_t i = pair.key_hash & mask;; i = (i + 1) & mask, pair.distance++)
 	{
-		hash = ((hash << 5) + hash) ^ *key;
-	} while (*key++);
-	return hash;
+		struct key_value_pair* slot = &map->data[i];
+		if (slot->distance == 0)
+		{
+			*slot = pair;
+			return;
+		}
+		if (slot->distance < pair.distance)
+		{
+			struct key_value_pair poorer = *slot;
+			*slot = pair;
+			pair = poorer;
+		}
+	}
 }
 
-bool hashmap_set(hashmap_t map, const char* key, value_t val)
+/* grows an inline map's vector, or moves its pairs into a table once it would pass HASHMAP_INLINE_MAX */
+static inline bool hashmap_reserve_inline(hashmap_t map)
 {
-	hash_t hash = hashmap_djb3(key);
-	if (EXISTS(map, hash))
+	int new_count = map->reserved > 0 ? map->reserved * 2 : HASHMAP_INLINE_START;
+	if (new_count <= HASHMAP_INLINE_MAX)
 	{
-		map->data[hashmap_find(map, hash)].value = val;
+		size_t old_size = sizeof * map->pairs * map->reserved,
+			new_size = sizeof * map->pairs * new_count;
+		struct inline_pair* new = allocator_realloc(map->allocator, map->pairs, old_size, new_size, ALLOC_OBJECT);
+		if (new == NULL)
+		{
+			return false;
+		}
+		map->pairs = new;
+		map->reserved = new_count;
+#ifdef JSON_STATS
+		map->resizes++;
+#endif
 		return true;
 	}
 
-	int i = hashmap_next_free(map, hash);
-	if (i == NOT_FOUND)
+	struct key_value_pair* table = hashmap_alloc_pairs(map->allocator, HASHMAP_START_RESERVE);
+	if (table == NULL)
+	{
+		return false;
+	}
+	struct inline_pair* prev = map->pairs;
+	map->data = table;
+	map->reserved = HASHMAP_START_RESERVE;
+#ifdef JSON_STATS
+	map->resizes++;
+#endif
+	for (int i = 0; i < map->cache_count; i++)
+	{
+		hashmap_place(map, (struct key_value_pair) { .key = prev[i].key, .key_hash = hashmap_hash(prev[i].key, strlen(prev[i].key)), .value = prev[i].value });
+	}
+	allocator_free(map->allocator, prev, ALLOC_OBJECT);
+	return true;
+}
+
+static inline bool hashmap_reserve(hashmap_t map, int new_count)
+{
+	struct key_value_pair* new = hashmap_alloc_pairs(map->allocator, new_count);
+	if (new == NULL)
+	{
+		return false;
+	}
+	struct key_value_pair* prev = map->data;
+	int prev_count = map->reserved;
+	map->data = new;
+	map->reserved = new_count;
+#ifdef JSON_STATS
+	map->resizes++;
+#endif
+	for (int i = 0; i < prev_count; i++)
+	{
+		if (prev[i].distance != 0)
+		{
+			hashmap_place(map, prev[i]);
+		}
+	}
+	allocator_free(map->allocator, prev, ALLOC_OBJECT);
+	return true;
+}
+
+static inline bool hashmap_set_internal(hashmap_t map, const char* key, const hash_t* known_hash, value_t val)
+{
+	if (HASHMAP_IS_INLINE(map))
+	{
+		int i = hashmap_find_inline(map, key);
+		if (i != NOT_FOUND)
+		{
+			map->pairs[i].value = val;
+			return true;
+		}
+		if (map->cache_count == map->reserved && !hashmap_reserve_inline(map))
+		{
+			return false;
+		}
+		if (HASHMAP_IS_INLINE(map))
+		{
+			map->pairs[map->cache_count++] = (struct inline_pair){ key, val };
+			return true;
+		}
+	}
+
+	hash_t hash = known_hash != NULL ? *known_hash : hashmap_hash(key, strlen(key));
+	int i = hashmap_find_table(map, key, hash);
+	if (i != NOT_FOUND)
+	{
+		map->data[i].value = val;
+		return true;
+	}
+
+	if (map->cache_count + 1 > HASHMAP_MAX_LOAD(map->reserved) && !hashmap_reserve(map, map->reserved * 2))
 	{
 		return false;
 	}
 
 	map->cache_count++;
-	map->data[i].key = key;
-	map->data[i].key_hash = hash;
-	map->data[i].value = val;
+	hashmap_place(map, (struct key_value_pair) { .key = key, .key_hash = hash, .value = val });
 	return true;
 }
 
+bool hashmap_set(hashmap_t map, const char* key, value_t val)
+{
+	return hashmap_set_internal(map, key, NULL, val);
+}
+
+bool hashmap_set_hashed(hashmap_t map, const char* key, uint32_t hash, value_t val)
+{
+	return hashmap_set_internal(map, key, &hash, val);
+}
+
+uint32_t hashmap_key_hash(const char* key)
+{
+	return hashmap_hash(key, strlen(key));
+}
+
 void hashmap_remove(hashmap_t map, const char* key)
 {
-	hash_t hash = hashmap_djb3(key);
-	if (!EXISTS(map, hash))
+	if (HASHMAP_IS_INLINE(map))
 	{
+		int i = hashmap_find_inline(map, key);
+		if (i != NOT_FOUND)
+		{
+			memmove(&map->pairs[i], &map->pairs[i + 1], sizeof * map->pairs * (map->cache_count - i - 1));
+			map->cache_count--;
+		}
 		return;
 	}
 
-	map->data[hashmap_find(map, hashmap_djb3(key))].key_hash = 0;
+	int i = hashmap_find_table(map, key, hashmap_hash(key, strlen(key)));
+	if (i == NOT_FOUND)
+	{
+		return;
+	}
+
+	int mask = map->reserved - 1;
+	for (int next = (i + 1) & mask; map->data[next].distance > 1; i = next, next = (next + 1) & mask)
+	{
+		map->data[i] = map->data[next];
+		map->data[i].distance--;
+	}
+	map->data[i] = (struct key_value_pair){ 0 };
 	map->cache_count--;
 }
 
 void hashmap_clear(hashmap_t map)
 {
-	memset(map->data, 0, sizeof * map->data * map->reserved);
+	if (!HASHMAP_IS_INLINE(map))
+	{
+		memset(map->data, 0, sizeof * map->data * map->reserved);
+	}
 	map->cache_count = 0;
 }
 
 bool hashmap_exists(const hashmap_t map, const char* key)
 {
-	return EXISTS(map, hashmap_djb3(key));
+	return hashmap_find(map, key, NULL) != NULL;
 }
 
 value_t hashmap_get(hashmap_t map, const char* key)
 {
-	hash_t hash = hashmap_djb3(key);
-	assert(EXISTS(map, hash));
-	return map->data[hashmap_find(map, hash)].value;
+	value_t* val = hashmap_find(map, key, NULL);
+	assert(val != NULL);
+	return *val;
+}
+
+bool hashmap_get_hashed(const hashmap_t map, const char* key, uint32_t hash, value_t* out)
+{
+	value_t* val = hashmap_find(map, key, &hash);
+	if (val == NULL)
+	{
+		return false;
+	}
+	*out = *val;
+	return true;
 }
 
 int hashmap_count(const hashmap_t map)
@@ -306,11 +827,60 @@ const char* hashmap_next_key(const hashmap_t map)
 
 void hashmap_iterate(hashmap_t map, void* user, hashmap_iterator func)
 {
+	if (HASHMAP_IS_INLINE(map))
+	{
+		for (int i = 0; i < map->cache_count; i++)
+		{
+			func(map, user, map->pairs[i].key, map->pairs[i].value);
+		}
+		return;
+	}
 	for (int i = 0; i < map->reserved; i++)
 	{
-		if (map->data[i].key_hash != 0)
+		if (map->data[i].distance != 0)
 		{
 			func(map, user, map->data[i].key, map->data[i].value);
 		}
 	}
-}
\ No newline at end of file
+}
+
+#ifdef JSON_STATS
+size_t arena_memory_usage(const arena_t arena)
+{
+	size_t total = sizeof * arena;
+	for (const struct arena_block* block = arena->head; block != NULL; block = block->prev)
+	{
+		total += ARENA_ALIGN(sizeof * block) + block->size;
+	}
+	return total;
+}
+
+size_t array_memory_usage(const array_t array)
+{
+	return sizeof * array + sizeof * array->data * array->reserved;
+}
+
+size_t hashmap_memory_usage(const hashmap_t map)
+{
+	return sizeof * map + (HASHMAP_IS_INLINE(map) ? sizeof * map->pairs : sizeof * map->data) * map->reserved;
+}
+
+/* inline maps are scanned from their first pair, tables from each key's home slot */
+hashmap_stats_t hashmap_stats(const hashmap_t map)
+{
+	hashmap_stats_t stats = { .resizes = map->resizes };
+	if (HASHMAP_IS_INLINE(map))
+	{
+		stats.probes = (size_t)map->cache_count * (map->cache_count + 1) / 2;
+		stats.longest_probe = map->cache_count;
+		return stats;
+	}
+	for (int i = 0; i < map->reserved; i++)
+	{
+		int distance = (int)map->data[i].distance;
+		stats.probes += distance;
+		stats.longest_probe = distance > stats.longest_probe ? distance : stats.longest_probe;
+	}
+	return stats;
+}
+#endif
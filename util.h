@@ -6,7 +6,10 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+typedef struct arena* arena_t;
 typedef struct array* array_t;
 typedef struct hashmap* hashmap_t;
 
@@ -17,7 +20,9 @@ typedef enum value_type
 	TYPE_OBJECT,
 	TYPE_ARRAY,
 	TYPE_BOOLEAN,
-	TYPE_NULL
+	TYPE_NULL,
+	TYPE_INTEGER, /* only produced when parsing with JSON_PARSE_INTEGERS */
+	TYPE_UINTEGER /* same as TYPE_INTEGER, for integers past INT64_MAX that fit in a uint64_t */
 } value_type_t;
 
 typedef struct value
@@ -30,11 +35,82 @@ typedef struct value
 		hashmap_t object;
 		array_t array;
 		bool boolean;
+		int64_t integer;
+		uint64_t uinteger;
 	} data;
 } value_t;
 
+/* val's number as a double, whether it is a TYPE_NUMBER, TYPE_INTEGER or TYPE_UINTEGER. Integers past 2^53 are rounded */
+double value_to_number(value_t val);
+
+/* what an allocation holds, so allocators can account for or place each kind on its own */
+typedef enum alloc_kind
+{
+	ALLOC_ARRAY, /* an array's struct or elements */
+	ALLOC_OBJECT, /* a hashmap's struct or entries */
+	ALLOC_STRING, /* a string value */
+	ALLOC_KEY, /* an object's key */
+	ALLOC_ARENA, /* an arena or one of its blocks */
+	ALLOC_KIND_COUNT
+} alloc_kind_t;
+
+/*	where memory comes from. realloc is told the size ptr had, which is 0 when ptr is NULL, and free is never given NULL.
+	Containers keep a pointer to their allocator, so it must outlive them. NULL stands for malloc, realloc and free
+	wherever an allocator is taken */
+typedef struct allocator
+{
+	void* (*alloc)(void* user, size_t size, alloc_kind_t kind);
+	void* (*realloc)(void* user, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind);
+	void (*free)(void* user, void* ptr, alloc_kind_t kind);
+	void* user;
+} allocator_t;
+
+/* allocates size bytes of kind from allocator. Returns NULL on failure */
+void* allocator_alloc(const allocator_t* allocator, size_t size, alloc_kind_t kind);
+/* resizes ptr, old_size bytes of kind from allocator, to new_size bytes. Returns NULL on failure, leaving ptr as it was */
+void* allocator_realloc(const allocator_t* allocator, void* ptr, size_t old_size, size_t new_size, alloc_kind_t kind);
+/* gives ptr back to allocator. Does nothing to NULL */
+void allocator_free(const allocator_t* allocator, void* ptr, alloc_kind_t kind);
+
+/* what a counting allocator has seen, kept per kind */
+typedef struct alloc_counts
+{
+	size_t calls[ALLOC_KIND_COUNT], /* allocations and reallocations */
+		frees[ALLOC_KIND_COUNT],
+		bytes[ALLOC_KIND_COUNT], /* held right now */
+		peak; /* most bytes held at once, of every kind together */
+} alloc_counts_t;
+
+/*	an allocator that passes everything on to malloc, realloc and free, counting into counts. Each allocation carries
+	a small header with its size. counts isn't locked, so an allocator shouldn't be shared between threads */
+allocator_t allocator_counting(alloc_counts_t* counts);
+/* bytes held by counts, of every kind together */
+size_t alloc_counts_bytes(const alloc_counts_t* counts);
+
+/*	creates a region allocator. Memory is handed out from a chain of blocks of at least block_size bytes (0 for default)
+	by bumping a pointer, and is only given back all at once by arena_destroy. */
+arena_t arena_create(size_t block_size);
+/* arena_create, with the arena and its blocks allocated from blocks, which may be NULL */
+arena_t arena_create_with(size_t block_size, const allocator_t* blocks);
+/* frees every block owned by the arena, and with them everything allocated from it */
+void arena_destroy(arena_t arena);
+/* gives back everything allocated from the arena while keeping its current block for reuse */
+void arena_reset(arena_t arena);
+/* allocates size bytes aligned for any value_t member. Returns NULL on failure */
+void* arena_alloc(arena_t arena, size_t size);
+/* resizes ptr from old_size to new_size bytes. Extends in place when ptr is the arena's last allocation, otherwise copies */
+void* arena_realloc(arena_t arena, void* ptr, size_t old_size, size_t new_size);
+/* an allocator handing out memory from arena, whose free does nothing. It lives as long as the arena */
+const allocator_t* arena_allocator(arena_t arena);
+
 /* creates an array list */
 array_t array_create(void);
+/* creates an array list whose storage comes from arena. array_destroy does nothing to it, arena_destroy frees it */
+array_t array_create_in(arena_t arena);
+/* array_create_in, with room for reserved values before the array has to grow. Arena may be NULL */
+array_t array_create_sized_in(arena_t arena, int reserved);
+/* creates an array list whose storage comes from allocator, with room for reserved values. Allocator may be NULL */
+array_t array_create_with(const allocator_t* allocator, int reserved);
 /* destroys an array and all its values */
 void array_destroy(array_t array);
 /* pushes a value onto the array */
@@ -47,6 +123,8 @@ bool array_add(array_t array, int i, value_t val);
 void array_remove(array_t array, int i);
 /* clears array, sets count = 0 */
 void array_clear(array_t array);
+/* drops every value past the first count */
+void array_truncate(array_t array, int count);
 /* gets value at index i */
 value_t array_get(array_t array, int i);
 /* returns amount of elements in array */
@@ -58,6 +136,12 @@ const value_t* array_data(const array_t array);
 
 /* creates a hashmap */
 hashmap_t hashmap_create(void);
+/* creates a hashmap whose storage comes from arena. hashmap_destroy does nothing to it, arena_destroy frees it */
+hashmap_t hashmap_create_in(arena_t arena);
+/* hashmap_create_in, with room for count entries before the map has to grow. Arena may be NULL */
+hashmap_t hashmap_create_sized_in(arena_t arena, int count);
+/* creates a hashmap whose storage comes from allocator, with room for count entries. Allocator may be NULL */
+hashmap_t hashmap_create_with(const allocator_t* allocator, int count);
 /* destroys a hashmap and all its entries */
 void hashmap_destroy(hashmap_t map);
 /* adds an entry with key and copies val into it. If the entry already exists, it replaces it. Returns false on failure, true on success */
@@ -73,6 +157,13 @@ value_t hashmap_get(hashmap_t map, const char* key);
 /* returns count of entries */
 int hashmap_count(const hashmap_t map);
 
+/* the hash hashmaps give key. Computing it once lets callers set or look up the same key in many maps without rehashing it */
+uint32_t hashmap_key_hash(const char* key);
+/* hashmap_set for a key whose hashmap_key_hash is already known */
+bool hashmap_set_hashed(hashmap_t map, const char* key, uint32_t hash, value_t val);
+/* copies the value of key, whose hashmap_key_hash is already known, into out. Returns false if map does not contain key */
+bool hashmap_get_hashed(const hashmap_t map, const char* key, uint32_t hash, value_t* out);
+
 /* sets half of a pair. val can either be a key or a value of that pair, use hashmap_state to query whats expected */
 bool hashmap_next_set(hashmap_t map, value_t val);
 /* queries what the hashmap is expecting next for "hashmap_set_next" */
@@ -80,4 +171,23 @@ const char* hashmap_next_key(const hashmap_t map);
 
 typedef void (*hashmap_iterator)(hashmap_t map, void* user, const char* key, value_t val);
 /* iterates through hashmap, calling func on each valid kvp */
-void hashmap_iterate(hashmap_t map, void* user, hashmap_iterator func);
\ No newline at end of file
+void hashmap_iterate(hashmap_t map, void* user, hashmap_iterator func);
+
+#ifdef JSON_STATS
+/* bytes held by arena: its struct and every block, used or not */
+size_t arena_memory_usage(const arena_t arena);
+/* bytes held by array: its struct and every slot it reserved */
+size_t array_memory_usage(const array_t array);
+/* bytes held by map: its struct and every pair or slot it reserved. Keys aren't included */
+size_t hashmap_memory_usage(const hashmap_t map);
+
+typedef struct hashmap_stats
+{
+	int resizes; /* times the map's storage grew */
+	size_t probes; /* pairs or slots looked at to find every entry once */
+	int longest_probe; /* most looked at to find one entry */
+} hashmap_stats_t;
+
+/* how well map's entries are laid out for lookups */
+hashmap_stats_t hashmap_stats(const hashmap_t map);
+#endif
@@ -1,11 +1,19 @@
-#if 0
+#ifdef UTIL_TEST
 #include <assert.h>
 #include <time.h>
 #include "util.h"
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define TEST_COUNT 0x7FFF
 
+static void test_count_iterator(hashmap_t map, void* user, const char* key, value_t val)
+{
+	assert(hashmap_get(map, key).data.number == val.data.number);
+	(*(int*)user)++;
+}
+
 int main(int argc, char* argv[])
 {
 	srand(time(NULL));
@@ -39,6 +47,32 @@ int main(int argc, char* argv[])
 	}
 
 	assert(hashmap_count(map) == 0);
+
+	/* removing shifts later entries back, every other key must survive it and equal strings must find the same entry */
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		assert(hashmap_set(map, &keys[i * 8], (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+	}
+	for (int i = 0; i < TEST_COUNT; i += 2)
+	{
+		hashmap_remove(map, &keys[i * 8]);
+	}
+	assert(hashmap_count(map) == TEST_COUNT / 2);
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		char copy[8];
+		memcpy(copy, &keys[i * 8], sizeof copy);
+		assert(hashmap_exists(map, copy) == (i % 2 == 1));
+		if (i % 2 == 1)
+		{
+			assert(hashmap_get(map, copy).data.number == values[i]);
+		}
+	}
+	int iterated = 0;
+	hashmap_iterate(map, &iterated, test_count_iterator);
+	assert(iterated == TEST_COUNT / 2);
+	hashmap_clear(map);
+	assert(hashmap_count(map) == 0 && !hashmap_exists(map, &keys[8]));
 	hashmap_destroy(map);
 
 	array_t arr = array_create();
@@ -78,5 +112,79 @@ int main(int argc, char* argv[])
 	assert(array_count(arr) == 0);
 
 	array_destroy(arr);
+
+	/* sized containers hold exactly what they were sized for and still grow past it */
+	array_t sized = array_create_sized_in(NULL, 3);
+	hashmap_t sized_map = hashmap_create_sized_in(NULL, 12);
+	assert(sized && sized_map);
+	for (int i = 0; i < 20; i++)
+	{
+		assert(array_push(sized, (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+		assert(hashmap_set(sized_map, &keys[i * 8], (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+	}
+	array_truncate(sized, 2);
+	assert(array_count(sized) == 2 && array_get(sized, 1).data.number == values[1]);
+	assert(hashmap_count(sized_map) == 20 && hashmap_get(sized_map, &keys[19 * 8]).data.number == values[19]);
+	array_destroy(sized);
+	hashmap_destroy(sized_map);
+
+	arena_t arena = arena_create(256);
+	assert(arena);
+	char* first = arena_alloc(arena, 10);
+	assert(first && ((uintptr_t)first & 0xF) == 0);
+	assert(arena_realloc(arena, first, 10, 40) == first); /* last allocation grows in place */
+	char* second = arena_alloc(arena, 1000); /* larger than a quarter block, gets its own block */
+	assert(second);
+	memset(second, 0xCD, 1000);
+	char* third = arena_alloc(arena, 16);
+	assert(third >= first + 48 && third < first + 256); /* still served from the first block */
+
+	array_t arena_arr = array_create_in(arena);
+	hashmap_t arena_map = hashmap_create_in(arena);
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		assert(array_push(arena_arr, (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+		assert(hashmap_set(arena_map, &keys[i * 8], (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+	}
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		assert(array_get(arena_arr, i).data.number == values[i]);
+		assert(hashmap_get(arena_map, &keys[i * 8]).data.number == values[i]);
+	}
+	array_destroy(arena_arr); /* no-ops, the arena owns them */
+	hashmap_destroy(arena_map);
+	arena_destroy(arena);
+
+	/* containers with their own allocator give back everything they took, and counted arenas count their blocks */
+	alloc_counts_t counts = { 0 };
+	allocator_t counting = allocator_counting(&counts);
+	array_t counted_arr = array_create_with(&counting, 0);
+	hashmap_t counted_map = hashmap_create_with(&counting, 0);
+	assert(counted_arr && counted_map);
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		assert(array_push(counted_arr, (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+		assert(hashmap_set(counted_map, &keys[i * 8], (value_t) { .type = TYPE_NUMBER, .data.number = values[i] }));
+	}
+	for (int i = 0; i < TEST_COUNT; i += 2)
+	{
+		hashmap_remove(counted_map, &keys[i * 8]);
+	}
+	assert(hashmap_count(counted_map) == TEST_COUNT / 2 && hashmap_get(counted_map, &keys[8]).data.number == values[1]);
+	assert(counts.bytes[ALLOC_ARRAY] >= sizeof(value_t) * TEST_COUNT && counts.bytes[ALLOC_OBJECT] > 0);
+	assert(counts.calls[ALLOC_ARRAY] > 1 && counts.calls[ALLOC_OBJECT] > 1 && counts.calls[ALLOC_STRING] == 0);
+	assert(counts.peak >= alloc_counts_bytes(&counts)); /* tables are copied while both are held */
+	array_destroy(counted_arr);
+	hashmap_destroy(counted_map);
+	assert(alloc_counts_bytes(&counts) == 0 && counts.frees[ALLOC_ARRAY] == 2 && counts.frees[ALLOC_OBJECT] > 2);
+
+	arena = arena_create_with(256, &counting);
+	assert(arena && counts.calls[ALLOC_ARENA] == 1);
+	assert(arena_alloc(arena, 16) && arena_alloc(arena, 1000) && counts.calls[ALLOC_ARENA] == 3);
+	size_t array_calls = counts.calls[ALLOC_ARRAY];
+	array_t in_arena = array_create_with(arena_allocator(arena), 4);
+	assert(in_arena && counts.calls[ALLOC_ARRAY] == array_calls); /* taken from the arena's block */
+	arena_destroy(arena);
+	assert(alloc_counts_bytes(&counts) == 0 && counts.frees[ALLOC_ARENA] == 3);
 }
 #endif
\ No newline at end of file